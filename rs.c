@@ -9,35 +9,103 @@
 	Bugs: only deals with fbin settings cviq and flt4, data type for iqdata is hardcoded to float
 	Doc Bugs: block sign.nOwner is really sitecode, undefined block hasi
 
-	Notes: the binary RS file is bigendian by definition, so the program tests itself and corrects accordingly.
+	Notes: the binary RS file is bigendian by definition, so the program swaps bytes when it is built for a little endian host, see HOST_LITTLE_ENDIAN.
+
+	Large-file extension: a RIFF block header holds a 32 bit size, which limits a block to 4 GiB. Merged archives can have
+	AQFT and BODY superblocks larger than that. Such a block is written with the size field set to 0xffffffff (SIZE_EXTENDED),
+	followed immediately by the real size as a 64 bit bigendian value, and then the data block. The extended header is
+	therefore 16 bytes instead of 8. Blocks smaller than 0xffffffff bytes are always written with the plain 8 byte header,
+	so files that don't need the extension are unchanged.
 */
 
+#define _FILE_OFFSET_BITS 64	// 64 bit off_t for ftello() and fseeko(), even on 32 bit systems
+#define _GNU_SOURCE		// fopencookie() on glibc
+
 #include <stdlib.h>
 #include <stdio.h>
-#include <time.h>		// ctime()
+#include <time.h>		// ctime_r()
 #include <ctype.h>		// islower(), isprint()
 #include <unistd.h>		// fseek constant SEEK_END
 #include <string.h>		// memset()
 #include <stdint.h>		// uint32_t
+#include <inttypes.h>		// PRIu64
 #include <libgen.h>		// basename()
 #include <math.h>		// round()
-
-
-char Version[] = "rs.c version 1.0a 2021-02-15" ;
-int Debug = 0 ;			// Global debug flag to produce verbose output to stderr
+#include <sys/mman.h>		// mmap()
+#include <sys/stat.h>		// fstat()
+#include <fcntl.h>		// posix_fadvise()
+#include <errno.h>		// errno
+#include <pthread.h>		// reader threads for batch mode and fixup threads, may need -pthread on older systems
+#include <sys/uio.h>		// struct iovec
+#if defined(__linux__) && !defined(NO_IO_URING) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>	// the kernel interface, used through raw system calls so there's no library to link
+#include <sys/syscall.h>	// syscall()
+#define HAVE_IO_URING
+#endif
+#endif
+#ifdef HAVE_ZLIB
+#include <zlib.h>		// inflate(), build with -DHAVE_ZLIB and link with -lz to read gzip compressed files
+#endif
+#ifdef HAVE_LZMA
+#include <lzma.h>		// lzma_code(), build with -DHAVE_LZMA and link with -llzma to read xz compressed files
+#endif
+#if defined(__SSE2__)
+#include <immintrin.h>		// SSE2/SSSE3/AVX2 intrinsics for the bulk byte swaps
+#endif
+
+
+const char Version[] = "rs.c version 1.0a 2021-02-15" ;
+#ifndef DEBUG
+#define DEBUG 0
+#endif
+static const int Debug = DEBUG ;	// build with -DDEBUG=1 to produce verbose output to stderr. Fixed at build time, so threads can share it
 
 #define SIZE_LINE 256		// Maximum length of a line of ascii text
-
+#define SUFFIX_INDEX ".rsidx"	// appended to the name of an RS file to name its sweep index
+#define SIZE_KEYNAME 5		// a RIFF key as a string, 4 characters and the terminator
+#define SIZE_TIMESTRING 26	// the buffer needed by ctime_r()
+
+// define codes for the compressed formats that rsdump can read directly, see open_decompressed()
+#define COMPRESSION_NONE	0
+#define COMPRESSION_GZIP	1
+#define COMPRESSION_XZ		2
+#define SIZE_MAGIC		6		// enough bytes to recognize any of the compressed formats
+#define SIZE_DECOMPRESS_BUFFER	(256*1024)	// compressed bytes read at a time
+
+#define KEYNAME(key) strkey((key),(char [SIZE_KEYNAME]){ 0 })	// a RIFF key as a string, in a buffer that lasts until the end of the enclosing block
+
+
+// The binary file is big endian. Where the compiler says what byte order it targets, the endian fixups are settled at compile time:
+// on a big endian host they compile away and on a little endian host they become byte swap instructions, inlined into each caller.
+#if defined(__BYTE_ORDER__) && defined(__ORDER_LITTLE_ENDIAN__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define HOST_LITTLE_ENDIAN 1
+#elif defined(__BYTE_ORDER__) && defined(__ORDER_BIG_ENDIAN__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define HOST_LITTLE_ENDIAN 0
+#else
+#define HOST_LITTLE_ENDIAN check_little_endian()	// unknown compiler, so test at run time
+#endif
 
 typedef uint32_t fourcc ;	// four bytes that are subject to byte swapping
 
-// declare a node for the linked list
+// declare a node, the description of one RIFF block
 struct node
 {
 	fourcc key ;		// the key name
-	uint32_t size ;		// the size of the node's data block
+	uint64_t size ;		// the size of the node's data block
+	uint64_t offset ;	// the offset of the data block from the start of the file, set by the parser
+	int depth ;		// the number of superblocks enclosing this block, set by the parser
+	long parent ;		// the table index of the enclosing superblock, -1 at the top level
 	unsigned char *data ;	// the data block
-	struct node *next ;	// the next node
+	int bigendian ;		// 1 while the data block is still in file byte order, see fixup_node()
+} ;
+
+// declare a table of nodes, kept in one contiguous array in file order
+struct node_table
+{
+	struct node *nodes ;	// the array of nodes, grown as needed
+	size_t count ;		// the number of nodes in use
+	size_t capacity ;	// the number of nodes allocated
 } ;
 
 // define key value codes, used to recognize and label block types
@@ -73,6 +141,86 @@ struct node
 #define BINTYPE_FIX3	(fourcc )0x66697833	// "fix3"
 #define BINTYPE_FIX4	(fourcc )0x66697834	// "fix4"
 
+// define the layout of the data portion of each type of block, see Global_block_schemas
+struct block_sign				// contains only the data portion for this type of block, i.e. no header data (key, size)
+{
+	fourcc version ;			// file version
+	fourcc filetype ;			// file type
+	fourcc sitecode ; 			// owner code
+	uint32_t userflags ;			// user flags
+	char description[SIZE_DESCRIPTION] ;	// file description
+	char ownername[SIZE_OWNERNAME] ;	// owner name
+	char comment[SIZE_COMMENT] ;		// comment
+} __attribute__((packed)) ;	// make sure there's no padding
+
+struct block_mcda
+{
+	uint32_t filetimestamp ;		// mac timestamp of first sweep
+} __attribute__((packed)) ;	// make sure there's no padding
+
+struct block_dbrf
+{
+	double rxloss ;		// received power correction, in dB
+} __attribute__((packed)) ;	// make sure there's no padding
+
+struct block_cnst
+{
+	int32_t nchannels ;		// number of antennas/channels (normally 3)
+	int32_t nranges ;		// number of ranges
+	int32_t nsweeps ;		// number of sweeps (normally 32)
+	int32_t iqindicator ;		// iqindicator: 1=?, 2=IQ
+} __attribute__((packed)) ;	// make sure there's no padding
+
+struct block_hasi
+{
+	uint32_t hasi ;		// hasi (?)
+} __attribute__((packed)) ;	// make sure there's no padding
+
+struct block_swep
+{
+	int32_t samplespersweep ;	// number of samples per sweep/channels (normally 2048)
+	double sweepstart ;		// sweep start frequency in Hertz
+	double sweepbandwidth ;		// sweep bandwidth in Hertz
+	double sweeprate ;		// sweep rate in Hertz
+	int32_t rangeoffset ;		// rangeoffset (not used)
+} __attribute__((packed)) ;	// make sure there's no padding
+
+struct block_fbin
+{
+	fourcc bin_format ;	// format (normally 'cviq')
+	fourcc bin_type ;	// type of ALVL data ('flt8','flt4','fix4','fix3','fix2')
+} __attribute__((packed)) ;	// make sure there's no padding
+
+struct block_rtag
+{
+	uint32_t rtag ;		// receiver position (?)
+} __attribute__((packed)) ;	// make sure there's no padding
+
+struct block_gps1
+{
+	double lat ;				// GPS latitude in radians
+	double lon ;				// GPS longitude in radians
+	double alt ;				// GPS altitude in meters
+	int32_t gpstimestamp ;			// GPS timestamp in appletime
+} __attribute__((packed)) ;	// make sure there's no padding
+
+struct block_indx
+{
+	uint32_t index ;		// index
+} __attribute__((packed)) ;	// make sure there's no padding
+
+struct block_scal
+{
+	double scalar_one ;		// scaling value for I samples
+	double scalar_two ;		// scaling value for Q samples
+} __attribute__((packed)) ;	// make sure there's no padding
+
+struct block_iqdata_float		// hardcoded type
+{
+	float isample ;		// I sample		// hardcoded type
+	float qsample ;		// Q sample		// hardcoded type
+} __attribute__((packed)) ;	// make sure there's no padding
+
 // define a struct to hold values that are referenced across blocks
 struct config
 {
@@ -86,164 +234,528 @@ struct config
 struct block_header
 {
 	fourcc key ;
-	uint32_t size ;
+	uint32_t size ;		// SIZE_EXTENDED means a 64 bit size follows the header
 } __attribute__((packed)) ;	// disable padding to make the header line up with the file data
 
-struct block_functions						// this struct is used to relate a key name with a set of functions
+#define SIZE_EXTENDED	0xffffffff	// block header size value that marks the large-file extension, see the notes at the top
+
+#define KEY_RSIX	(fourcc )0x52534958	// "RSIX", the key at the start of a sweep index file
+#define INDEX_VERSION	1			// the version of the sweep index file layout
+#define NUM_SWEEP_KEYS	6			// the number of block types recorded for each sweep in an index
+#define SIZE_HEADER_BUFFER 64			// stdio buffer size used when reading only block headers
+
+struct index_entry		// where one block of a sweep lies in the RS file
+{
+	uint64_t offset ;	// the offset of the data block from the start of the file, 0 if the sweep has no such block
+	uint64_t size ;		// the size of the data block
+} ;
+
+struct sweep_entry		// the blocks of one sweep, in the order of Global_sweep_keys
+{
+	struct index_entry block[NUM_SWEEP_KEYS] ;
+} ;
+
+struct index_header		// the start of a sweep index file, followed by nsweeps sweep entries, all bigendian
+{
+	fourcc key ;		// KEY_RSIX
+	uint32_t version ;	// INDEX_VERSION
+	uint64_t filesize ;	// the size of the RS file when it was indexed
+	int64_t mtime ;		// the modification time of the RS file when it was indexed
+	uint64_t nsweeps ;	// the number of sweep entries
+} __attribute__((packed)) ;	// make sure there's no padding
+
+struct sweep_index		// a sweep index in memory
+{
+	uint64_t filesize ;
+	int64_t mtime ;
+	uint64_t nsweeps ;
+	struct sweep_entry *sweeps ;
+	uint64_t capacity ;	// the number of sweep entries allocated, while the index is being built
+} ;
+
+struct rs_reader		// an RS file opened for random access to its iq samples, see rs_open()
+{
+	unsigned char *file ;		// the whole file, mapped read-only, or decompressed into memory
+	size_t filesize ;
+	int mapped ;			// 1 if file is a map, 0 if it was malloc'd
+	int32_t nchannels ;		// from the cnst block
+	int32_t nranges ;		// from the cnst block
+	int32_t nsweeps ;		// from the cnst block, the index has the number of sweeps actually in the file
+	fourcc bin_format ;		// from the fbin block
+	fourcc bin_type ;		// from the fbin block
+	struct sweep_index index ;	// where the blocks of each sweep are
+} ;
+
+#define MAX_FILTER_KEYS		32		// the most block keys that rsdump -K can select
+#define ALL_CHANNELS		UINT64_MAX	// the channel mask when rsdump -C isn't given
+
+struct dump_filter		// the parts of a file that rsdump selects with -S, -N, -C, -R and -K, see rsdump_select()
+{
+	int active ;			// 1 if any selection was given
+	uint64_t first_sweep ;		// sweeps by number, counting from 0, as the reader functions count them
+	uint64_t last_sweep ;
+	int by_indx ;			// 1 if sweeps are also selected by the index in their indx block
+	uint64_t first_indx ;
+	uint64_t last_indx ;
+	uint64_t channels ;		// a bit for each selected channel, or ALL_CHANNELS
+	uint64_t first_range ;		// range cells, counting from 0
+	uint64_t last_range ;
+	int cells ;			// 1 if only some of the samples of an afft or ifft block are selected
+	fourcc keys[MAX_FILTER_KEYS] ;	// the selected block keys, all of them if nkeys is 0
+	int nkeys ;
+} ;
+
+struct recovered_sweep		// a run of sweep blocks found by the recovery scan, see parse_recover()
+{
+	size_t first ;			// the table index of its first block
+	size_t count ;			// the number of blocks in the run
+	unsigned int found ;		// a bit for each slot of Global_sweep_keys that the run has
+	int broken ;			// 1 if the run was cut short by damage
+} ;
+
+#define MAX_UNKNOWN_RUN	16		// the most blocks with unknown keys in a row that the recovery scan follows to a known one
+
+#define SIZE_TAR_BLOCK	512		// tar archives are made of 512 byte blocks, each member starts with a header block
+
+struct tar_member		// the state behind a stream opened by open_tar_member()
+{
+	FILE *archive ;			// the tar stream, positioned in the member's data
+	uint64_t remaining ;		// bytes of the member's data not yet read from the archive
+	unsigned char prefix[sizeof(struct block_header)] ;	// the start of the member, read to recognize it
+	size_t pending ;		// bytes in prefix
+	size_t position ;		// the next byte of prefix to pass on
+} ;
+
+#define BATCH_DEPTH	16		// files read ahead of the one being dumped in batch mode
+#define BATCH_THREADS	4		// reader threads when io_uring isn't available
+#define SIZE_BATCH_READ	(1024*1024*1024)	// the most read at once, larger files take several reads
+#define DIRECT_ALIGN	4096		// buffer, offset and length alignment for O_DIRECT reads, enough for any common device
+
+#define BATCH_WAITING	0		// not opened yet
+#define BATCH_READING	1		// being read
+#define BATCH_READ	2		// the whole file is in data
+#define BATCH_FAILED	3		// the file couldn't be opened or read, the error has been reported
+
+struct batch_file		// one input file of a batch scan
+{
+	char *name ;
+	int fd ;
+	unsigned char *data ;		// the file contents, once read
+	uint64_t size ;			// the size of the file when it was opened
+	uint64_t span ;			// the size of data, rounded up to DIRECT_ALIGN for O_DIRECT reads
+	uint64_t done ;			// bytes read so far
+	int direct ;			// 1 to keep the file out of the page cache, see open_batch_file()
+	int state ;			// one of the BATCH_ codes
+	struct iovec iov ;		// the read in flight, io_uring only
+} ;
+
+struct batch			// a batch scan, shared by the readers and the dumper
+{
+	struct batch_file *files ;
+	int nfiles ;
+	int next_read ;			// the next file to start reading
+	int next_dump ;			// the next file to dump, reads stay within BATCH_DEPTH of it
+	int recover ;			// 1 to dump what can be salvaged from damaged files, see parse_recover()
+	int hex ;			// 1 to write hex floats, see struct output
+	pthread_mutex_t lock ;		// guards next_read, next_dump and the file states, reader threads only
+	pthread_cond_t changed ;	// signalled when a file has been read or dumped
+} ;
+
+#ifdef HAVE_IO_URING
+struct uring			// an io_uring instance, with its rings mapped by hand
+{
+	int fd ;
+	unsigned char *sq_ring ;
+	unsigned char *cq_ring ;	// the same map as sq_ring on kernels with IORING_FEAT_SINGLE_MMAP
+	size_t sq_ring_size ;
+	size_t cq_ring_size ;
+	struct io_uring_sqe *sqes ;
+	size_t sqes_size ;
+	unsigned *sq_head ;
+	unsigned *sq_tail ;
+	unsigned *sq_mask ;
+	unsigned *sq_array ;
+	unsigned *cq_head ;
+	unsigned *cq_tail ;
+	unsigned *cq_mask ;
+	struct io_uring_cqe *cqes ;
+	unsigned to_submit ;		// entries queued since the last io_uring_enter
+} ;
+#endif
+
+#define FIXUP_THREADS_MAX	16		// the most threads that fix up the byte order of a large file
+#define FIXUP_PARALLEL_MIN	(4*1024*1024)	// in smaller files each block is fixed up by the dumper when it gets to it
+#define FIXUP_CHUNK	64		// nodes claimed at a time by a fixup thread
+
+struct fixup_work		// the nodes of a parsed file, shared out among the fixup threads
 {
-	fourcc key ;						// a 4 byte block key
-	int (*fixup)(struct node *) ;				// a pointer to a function that is called to perform endian fixup on the data block
-	int (*make)(struct node *, struct config *, FILE *) ;	// a pointer to a function that is called to create a data block from text
-	int (*dump)(struct node *, struct config *, FILE *) ;	// a pointer to a function that is called to produce text output from a data block
-	int (*gen)(struct node *, FILE *) ;			// a pointer to a function that is called to write out a binary version of the block
+	struct node_table *table ;
+	size_t next ;			// the next node to claim, only changed with __atomic_fetch_add()
+} ;
+
+// define the types of field in a data block, each is dumped as a line "name:value"
+#define FIELD_KEY	0	// a 4 byte block key, such as a format or a site code
+#define FIELD_HEX32	1	// a 32 bit unsigned integer, written in hex
+#define FIELD_UINT32	2	// a 32 bit unsigned integer
+#define FIELD_INT32	3	// a 32 bit signed integer
+#define FIELD_DOUBLE	4	// an 8 byte float, written with count digits after the point
+#define FIELD_TEXT	5	// count characters, not byte swapped
+#define FIELD_MACTIME	6	// a 32 bit time in seconds since 1904, written as seconds since 1970 and left out when it is 0
+#define FIELD_BYTES	7	// the rest of the block as raw bytes, not byte swapped
+#define FIELD_IQ	8	// the rest of the block as I/Q samples, a line each with the shortest digits that read back exactly
+
+#define SCHEMA_SUPERBLOCK	0x1	// the block has no data of its own, only sub blocks
+#define SCHEMA_LAST		0x2	// the block ends the file, no blank line follows it in the text version
+
+#define NO_CONFIG	-1		// a field that is not remembered in struct config
+#define MAC_EPOCH	2082844800	// the seconds from 1904-01-01 00:00:00 to 1970-01-01 00:00:00
+
+struct block_field		// one field of a data block
+{
+	const char *name ;	// the label of the field's line in the text version
+	int type ;		// one of the FIELD_ codes
+	size_t offset ;		// where the field starts in the data block
+	int count ;		// the length of a FIELD_TEXT, or the digits after the point for a FIELD_DOUBLE
+	int config ;		// the offset in struct config of a copy kept for later blocks, or NO_CONFIG
+} ;
+
+struct block_schema		// this struct is used to relate a key name with the layout of its block
+{
+	fourcc key ;				// a 4 byte block key
+	int flags ;				// SCHEMA_ bits
+	size_t size ;				// the smallest data block that holds all the fields, anything less is truncated
+	const struct block_field *fields ;	// the fields of the data block in file order, see the FIELD_ codes
+	int nfields ;
+} ;
+
+#define ENV_BLOCKS	"RS_BLOCKS"	// the environment variable that names a file of extra block definitions, see load_block_definitions()
+#define REGISTRY_BITS	8		// the block registry hash table has 1 << REGISTRY_BITS slots
+#define REGISTRY_SIZE	(1 << REGISTRY_BITS)
+#define MAX_BLOCK_TYPES	(REGISTRY_SIZE/2)	// keeps the hash table at most half full, so probe chains stay short
+#define MAX_FIELDS	64		// the most fields in a block definition
+
+struct block_registry		// the block types known to this run, the built-in ones and any loaded from a definitions file
+{
+	const struct block_schema *slots[REGISTRY_SIZE] ;	// an open addressing hash table on the key, NULL marks an empty slot
+	const struct block_schema *schemas[MAX_BLOCK_TYPES] ;	// the same schemas in the order they were registered
+	int count ;
+} ;
+
+#define SIZE_OUTPUT_BUFFER	(1024*1024)	// the text dump is written in chunks of this size
+
+struct output		// an append-only buffer for the text dump, the out_ functions format into it and it is written with write() when full
+{
+	FILE *file ;		// the stream the text goes to, or NULL to keep all the text in memory
+	char *data ;
+	size_t length ;		// bytes of text waiting in data
+	size_t size ;		// bytes allocated for data
+	int err ;		// set by the first failure, later appends are dropped
+	int hex ;		// 1 to write the I/Q samples and the double fields as C99 hex floats, see format_hex()
+} ;
+
+#define RENDER_THREADS_MAX	16		// the most threads that render the text of a large file
+#define RENDER_PARALLEL_MIN	(4*1024*1024)	// smaller files are dumped by one thread
+#define RENDER_CHUNK_SIZE	(256*1024)	// bytes of blocks rendered as one piece of work
+#define RENDER_WINDOW		2		// chunks per thread that may be rendered ahead of the one being written
+
+struct render_chunk		// a run of nodes rendered by one thread, with the config the serial dump would have when it got to them
+{
+	size_t first ;
+	size_t last ;			// one past the last node
+	struct config config ;
+} ;
+
+struct render_slot		// a buffer for the text of one chunk, the slots are reused in turn as the chunks are written
+{
+	struct output out ;
+	int ready ;			// 1 once the chunk is rendered, 0 once it is written
+	int err ;
+} ;
+
+struct render_work		// the chunks of a parsed file, shared out among the render threads and written in order
+{
+	struct node_table *table ;
+	struct render_chunk *chunks ;
+	size_t nchunks ;
+	struct render_slot *slots ;	// chunk n is rendered into slots[n % nslots]
+	size_t nslots ;
+	size_t next ;			// the next chunk to claim
+	size_t written ;		// chunks written so far, a chunk is only claimed once its slot is free
+	int failed ;			// stops the threads after an error
+	pthread_mutex_t lock ;		// guards next, written, failed and the ready flags
+	pthread_cond_t rendered ;	// signalled when a slot becomes ready
+	pthread_cond_t freed ;		// signalled when a slot is written, or on failure
 } ;
 
 
 int check_little_endian(void) ;
 void usage_rsdump(char *) ;
 void usage_rsgen(char *) ;
-int rsdump(FILE *, FILE *, int) ;
+int rsdump(FILE *, FILE *, int, int, int) ;
+int rsdump_stream(FILE *, FILE *, int, int) ;
+int dump_file_data(unsigned char *, size_t, FILE *, int, int, int) ;
+int rsdump_follow(FILE *, FILE *, int, int) ;
+int wait_for_data(int, uint64_t, uint64_t, struct stat *) ;
+int rsindex(FILE *, FILE *) ;
+int rstar(FILE *, FILE *, int, int) ;
+int rsbatch(char **, int, FILE *, int, int, int, int) ;
+int rsdump_direct(char *, FILE *, int, int, int) ;
+int open_batch_file(struct batch_file *) ;
+int read_batch_file(struct batch_file *) ;
+uint64_t batch_read_length(struct batch_file *) ;
+void close_batch_file(struct batch_file *) ;
+int dump_batch_file(struct batch_file *, FILE *, int, int, int) ;
+int batch_threads(struct batch *, FILE *, int) ;
+void *batch_reader(void *) ;
+#ifdef HAVE_IO_URING
+int batch_uring(struct batch *, FILE *, int) ;
+int uring_setup(struct uring *, unsigned) ;
+void uring_close(struct uring *) ;
+void uring_queue_read(struct uring *, struct batch_file *, int) ;
+int uring_enter(struct uring *, unsigned) ;
+void uring_reap(struct uring *, struct batch *) ;
+#endif
+uint64_t tar_number(unsigned char *, size_t) ;
+int check_tar_header(unsigned char *) ;
+int read_tar_names(FILE *, uint64_t, int, char *, uint64_t *) ;
+FILE *open_tar_member(struct tar_member *) ;
+int skip_input(FILE *, uint64_t) ;
+int read_block_header(FILE *, struct node *) ;
+int sweep_key_slot(fourcc) ;
+int add_sweep_block(struct sweep_index *, fourcc, uint64_t, uint64_t) ;
+int index_mapped_file(unsigned char *, uint64_t, struct sweep_index *) ;
+int write_sweep_index(struct sweep_index *, FILE *) ;
+int load_sweep_index(char *, FILE *, struct sweep_index *) ;
+void free_sweep_index(struct sweep_index *) ;
 int rsgen(FILE *, FILE *) ;
-int read_binary_file(FILE *, unsigned long, unsigned char *) ;
+int read_binary_file(FILE *, size_t, unsigned char *) ;
+int compression_format(unsigned char *, size_t) ;
+FILE *open_decompressed(FILE *) ;
+unsigned char *map_binary_file(FILE *, size_t *) ;
+unsigned char *load_binary_file(FILE *, size_t *) ;
 int check_header(unsigned char *) ;
-struct node *parse_file(unsigned char *, unsigned long) ;
-int parse_block(struct node *, unsigned char *, unsigned long) ;
+int parse_file(struct node_table *, unsigned char *, uint64_t) ;
+int parse_block(struct node_table *, unsigned char *, uint64_t, uint64_t, int, long) ;
+unsigned int decode_block_header(unsigned char *, uint64_t, struct node *) ;
+unsigned int header_size(uint64_t) ;
+unsigned int encode_block_header(struct node *, unsigned char *) ;
 int superblock(fourcc) ;
-void show_list(struct node *) ;
-void free_all_nodes(struct node *) ;
-void free_all_nodes_and_data(struct node *) ;
+struct node *new_node(struct node_table *, fourcc) ;
+void show_table(struct node_table *) ;
+void free_node_table(struct node_table *) ;
+int parse_recover(struct node_table *, unsigned char *, uint64_t, int *) ;
+unsigned int plausible_header(unsigned char *, uint64_t, uint64_t, struct node *) ;
+unsigned int plausible_unknown(unsigned char *, uint64_t, uint64_t, struct node *) ;
+uint64_t find_block_key(unsigned char *, uint64_t, uint64_t) ;
+int known_key(fourcc) ;
+int damaged_key(fourcc) ;
+int rs_open(struct rs_reader *, char *) ;
+void rs_close(struct rs_reader *) ;
+uint64_t find_head_block(struct rs_reader *, fourcc, uint64_t *) ;
+int rs_read_cells(struct rs_reader *, fourcc, uint64_t, int, int, int, int, struct block_iqdata_float *) ;
+int rs_read_cell(struct rs_reader *, fourcc, uint64_t, int, int, struct block_iqdata_float *) ;
+int rs_read_sweep(struct rs_reader *, fourcc, uint64_t, struct block_iqdata_float *) ;
+int rsdump_select(char *, FILE *, int, int, struct dump_filter *) ;
+int dump_sweeps(struct rs_reader *, struct dump_filter *, uint64_t, uint64_t, unsigned char **, uint64_t *, struct config *, struct output *) ;
+uint64_t sweep_start(struct rs_reader *, uint64_t) ;
+int dump_copy(struct node *, unsigned char *, unsigned char **, uint64_t *, struct config *, struct output *) ;
+int dump_cells(struct rs_reader *, fourcc, uint64_t, struct dump_filter *, struct output *) ;
+int selected_key(struct dump_filter *, fourcc) ;
+int parse_interval(char *, uint64_t *, uint64_t *) ;
+int parse_channels(char *, uint64_t *) ;
+int parse_keys(char *, struct dump_filter *) ;
+void free_node_table_and_data(struct node_table *) ;
 void debugdump(unsigned char *, int) ;
-void hexdump(unsigned char *, unsigned int, FILE *) ;
-void endian_fixup(void *, int) ;
-void swapcopy(unsigned char *, unsigned char *, int) ;
-void swapcopy2(unsigned char *, unsigned char *) ;
-void swapcopy4(unsigned char *, unsigned char *) ;
-void swapcopy8(unsigned char *, unsigned char *) ;
-char *strkey(fourcc) ;
-int fixup_sizes(struct node *) ;
-uint32_t calculate_body_size(struct node *) ;
-uint32_t calculate_head_size(struct node *) ;
-int set_block_size(struct node *, fourcc , uint32_t) ;
-int dump_list(struct node *, FILE *, int) ;
+void hexdump(const char *, unsigned char *, uint64_t, struct output *) ;
+static inline void endian_fixup(void *, int) ;
+static inline void endian_fixup_bulk4(void *, size_t) ;
+static inline void endian_fixup_bulk8(void *, size_t) ;
+void swapbulk4(unsigned char *, size_t) ;
+void swapbulk8(unsigned char *, size_t) ;
+char *strkey(fourcc, char *) ;
+int fixup_sizes(struct node_table *) ;
+uint64_t calculate_body_size(struct node_table *) ;
+uint64_t calculate_head_size(struct node_table *) ;
+int set_block_size(struct node_table *, fourcc , uint64_t) ;
+int dump_list(struct node_table *, struct output *, int) ;
+int dump_block(struct node *, struct config *, struct output *) ;
+int render_table(struct node_table *, struct output *, uint64_t) ;
+int plan_render(struct node_table *, struct render_chunk **, size_t *, size_t *, struct config *) ;
+void *render_worker(void *) ;
 void chomp(char *, int) ;
 int read_parameter(FILE *, char [], void *) ;
 int fixup_block(struct node *) ;
-struct block_functions *find_block_functions(fourcc) ;
-int rs_write(struct node *, FILE *) ;
-int count_iqdata_lines(FILE *) ;
-
-// a set of functions that dump the contents of a specific type of block
-int dump_block_aqft(struct node *, struct config *, FILE *) ;
-int dump_block_head(struct node *, struct config *, FILE *) ;
-int dump_block_sign(struct node *, struct config *, FILE *) ;
-int dump_block_mcda(struct node *, struct config *, FILE *) ;
-int dump_block_dbrf(struct node *, struct config *, FILE *) ;
-int dump_block_cnst(struct node *, struct config *, FILE *) ;
-int dump_block_hasi(struct node *, struct config *, FILE *) ;
-int dump_block_swep(struct node *, struct config *, FILE *) ;
-int dump_block_fbin(struct node *, struct config *, FILE *) ;
-int dump_block_body(struct node *, struct config *, FILE *) ;
-int dump_block_rtag(struct node *, struct config *, FILE *) ;
-int dump_block_gps1(struct node *, struct config *, FILE *) ;
-int dump_block_indx(struct node *, struct config *, FILE *) ;
-int dump_block_scal(struct node *, struct config *, FILE *) ;
-int dump_block_afft(struct node *, struct config *, FILE *) ;
-int dump_block_ifft(struct node *, struct config *, FILE *) ;
-int dump_block_end(struct node *, struct config *, FILE *) ;
-
-// a set of functions that fixup the data portion of a specific type of block
-int fixup_data_aqft(struct node *) ;
-int fixup_data_head(struct node *) ;
-int fixup_data_sign(struct node *) ;
-int fixup_data_mcda(struct node *) ;
-int fixup_data_dbrf(struct node *) ;
-int fixup_data_cnst(struct node *) ;
-int fixup_data_hasi(struct node *) ;
-int fixup_data_swep(struct node *) ;
-int fixup_data_fbin(struct node *) ;
-int fixup_data_body(struct node *) ;
-int fixup_data_rtag(struct node *) ;
-int fixup_data_gps1(struct node *) ;
-int fixup_data_indx(struct node *) ;
-int fixup_data_scal(struct node *) ;
-int fixup_data_afft(struct node *) ;
-int fixup_data_ifft(struct node *) ;
-int fixup_data_end(struct node *) ;
-
-// a set of functions that create a node for a specific type of block
-int make_node_aqft(struct node *, struct config *config, FILE *) ;
-int make_node_head(struct node *, struct config *config, FILE *) ;
-int make_node_sign(struct node *, struct config *config, FILE *) ;
-int make_node_mcda(struct node *, struct config *config, FILE *) ;
-int make_node_dbrf(struct node *, struct config *config, FILE *) ;
-int make_node_cnst(struct node *, struct config *config, FILE *) ;
-int make_node_hasi(struct node *, struct config *config, FILE *) ;
-int make_node_swep(struct node *, struct config *config, FILE *) ;
-int make_node_fbin(struct node *, struct config *config, FILE *) ;
-int make_node_body(struct node *, struct config *config, FILE *) ;
-int make_node_rtag(struct node *, struct config *config, FILE *) ;
-int make_node_gps1(struct node *, struct config *config, FILE *) ;
-int make_node_indx(struct node *, struct config *config, FILE *) ;
-int make_node_scal(struct node *, struct config *config, FILE *) ;
-int make_node_afft(struct node *, struct config *config, FILE *) ;
-int make_node_ifft(struct node *, struct config *config, FILE *) ;
-int make_node_end(struct node *, struct config *config, FILE *) ;
-
-// a set of functions that generate binary file data for a specific type of block
-int gen_block_aqft(struct node *, FILE *) ;
-int gen_block_head(struct node *, FILE *) ;
-int gen_block_sign(struct node *, FILE *) ;
-int gen_block_mcda(struct node *, FILE *) ;
-int gen_block_dbrf(struct node *, FILE *) ;
-int gen_block_cnst(struct node *, FILE *) ;
-int gen_block_hasi(struct node *, FILE *) ;
-int gen_block_swep(struct node *, FILE *) ;
-int gen_block_fbin(struct node *, FILE *) ;
-int gen_block_body(struct node *, FILE *) ;
-int gen_block_rtag(struct node *, FILE *) ;
-int gen_block_gps1(struct node *, FILE *) ;
-int gen_block_indx(struct node *, FILE *) ;
-int gen_block_scal(struct node *, FILE *) ;
-int gen_block_afft(struct node *, FILE *) ;
-int gen_block_ifft(struct node *, FILE *) ;
-int gen_block_end(struct node *, FILE *) ;
-
-
-int Global_flag_little_endian = 1 ;	// 1 indicates this code is little endian, 0 means it's big endian. The binary file is big endian.
+int fixup_node(struct node *) ;
+int fixup_table(struct node_table *, uint64_t) ;
+void *fixup_worker(void *) ;
+const struct block_schema *find_block_schema(fourcc) ;
+const struct block_schema *lookup_block_schema(fourcc) ;
+static inline unsigned int hash_key(fourcc) ;
+int register_block_schema(const struct block_schema *) ;
+int init_block_registry(void) ;
+int load_block_definitions(char *) ;
+int define_block(char *, char **) ;
+int rs_write(struct node_table *, FILE *) ;
+size_t count_iqdata_lines(FILE *) ;
+int read_iqdata_samples(struct block_iqdata_float *, size_t, struct config *, FILE *) ;
+int check_iqdata_format(struct config *) ;
+static inline int32_t pow5_bits(int32_t) ;
+static inline uint32_t log10_pow2(int32_t) ;
+static inline uint32_t log10_pow5(int32_t) ;
+static inline int multiple_of_pow5(uint32_t, uint32_t) ;
+static inline uint32_t mul_shift_32(uint32_t, uint64_t, int32_t) ;
+void shortest_float(uint32_t, uint32_t, uint32_t *, int32_t *) ;
+int format_float(float, char *) ;
+int format_iq_line(size_t, float, float, int, char *) ;
+int parse_float(char *, char **, float *) ;
+int format_hex(uint64_t, int, int, char *) ;
+int format_hex_float(float, char *) ;
+int format_hex_double(double, char *) ;
+int parse_hex_float(const char *, char **, double *) ;
+int out_open(struct output *, FILE *, int) ;
+int out_close(struct output *) ;
+int out_flush(struct output *) ;
+char *out_reserve(struct output *, size_t) ;
+void out_text(struct output *, const char *, size_t) ;
+void out_string(struct output *, const char *) ;
+void out_char(struct output *, char) ;
+void out_unsigned(struct output *, uint64_t) ;
+void out_signed(struct output *, int64_t) ;
+void out_hex(struct output *, uint32_t) ;
+void out_double(struct output *, double, int) ;
+void out_float(struct output *, float) ;
+void out_hex_double(struct output *, double) ;
+void out_key(struct output *, fourcc) ;
+int read_hex_bytes(FILE *, unsigned char **, size_t *) ;
+void swap_run(unsigned char *, int, size_t) ;
+void swap_fields(const struct block_schema *, unsigned char *, uint64_t) ;
+int dump_fields(const struct block_schema *, struct node *, struct config *, struct output *) ;
+int check_fields(const struct block_schema *, struct node *, struct config *, int) ;
+void take_config(const struct block_schema *, struct node *, struct config *) ;
+int make_fields(const struct block_schema *, fourcc, struct node_table *, struct config *, FILE *) ;
+int gen_fields(const struct block_schema *, struct node *, FILE *) ;
 
 
 int main(int argc, char *argv[])
 {
 	char *program_name = basename(argv[0]) ;
-	Global_flag_little_endian = check_little_endian() ;
 	int err = 0 ;
 	FILE *fdin ;
 	FILE *fdout ;
+	if( init_block_registry() )		// before any threads start, they only read the registry
+		return 1 ;
 	if( strcmp(program_name,"rsdump") == 0 )		// the program name must be rsdump or rsgen
 	{
 		// do rsdump
+		int just_header = 0 ;
+		int streaming = 0 ;
+		int make_index = 0 ;
+		int tar = 0 ;
+		int follow = 0 ;
+		int batch = 0 ;
+		int direct = 0 ;
+		int recover = 0 ;
+		int hex = 0 ;
+		struct dump_filter filter ;
+		memset(&filter,0,sizeof(struct dump_filter)) ;
+		filter.last_sweep = UINT64_MAX ;
+		filter.last_indx = UINT64_MAX ;
+		filter.channels = ALL_CHANNELS ;
+		filter.last_range = UINT64_MAX ;
+		while( argc > 1 && argv[1][0] == '-' && argv[1][1] != '\0' )	// options come before the file names
+		{
+			if( strcmp(argv[1],"-h") == 0 )
+				just_header = 1 ;
+			else if( strcmp(argv[1],"-s") == 0 )
+				streaming = 1 ;
+			else if( strcmp(argv[1],"-i") == 0 )
+				make_index = 1 ;
+			else if( strcmp(argv[1],"-t") == 0 )
+				tar = 1 ;
+			else if( strcmp(argv[1],"-f") == 0 || strcmp(argv[1],"--follow") == 0 )
+				follow = 1 ;
+			else if( strcmp(argv[1],"-b") == 0 )
+				batch = 1 ;
+			else if( strcmp(argv[1],"-d") == 0 )
+				direct = 1 ;
+			else if( strcmp(argv[1],"-r") == 0 )
+				recover = 1 ;
+			else if( strcmp(argv[1],"-x") == 0 )
+				hex = 1 ;
+			else if( argc > 2 && strchr("SNCRK",argv[1][1]) != NULL && argv[1][2] == '\0' )	// the selections take a value
+			{
+				int bad = 0 ;
+				switch( argv[1][1] )
+				{
+					case 'S':
+						bad = parse_interval(argv[2],&(filter.first_sweep),&(filter.last_sweep)) ;
+						break ;
+					case 'N':
+						bad = parse_interval(argv[2],&(filter.first_indx),&(filter.last_indx)) ;
+						filter.by_indx = 1 ;
+						break ;
+					case 'C':
+						bad = parse_channels(argv[2],&(filter.channels)) ;
+						filter.cells = 1 ;
+						break ;
+					case 'R':
+						bad = parse_interval(argv[2],&(filter.first_range),&(filter.last_range)) ;
+						filter.cells = 1 ;
+						break ;
+					case 'K':
+						bad = parse_keys(argv[2],&filter) ;
+						break ;
+				}
+				if( bad )
+				{
+					usage_rsdump(program_name) ;
+					return 1 ;
+				}
+				filter.active = 1 ;
+				argv++ ;
+				argc-- ;
+			}
+			else
+			{
+				usage_rsdump(program_name) ;
+				return 1 ;
+			}
+			argv++ ;
+			argc-- ;
+		}
 		if( argc < 2 )
 		{
 			usage_rsdump(program_name) ;
 			return 0 ;
 		}
-		int just_header = 0 ;
-		if( strcmp(argv[1],"-h") == 0 )
+		if( (tar && make_index) || ((direct || recover) && (streaming || make_index || tar || follow))	// the offsets in an index must point into an RS file, direct and recovery modes read whole files
+			|| (follow && (make_index || tar || batch))	// follow mode dumps one plain RS file as it grows
+			|| (batch && (make_index || tar || streaming))	// batch mode reads whole RS files and dumps them to stdout
+			|| (filter.active && (streaming || make_index || tar || follow || batch || direct || recover)) )	// the selections need random access to the file
 		{
-			just_header = 1 ;
-			argv++ ;
-			argc-- ;
+			usage_rsdump(program_name) ;
+			return 1 ;
 		}
+		if( batch )	// every argument is an input file, the dumps go to stdout
+			return rsbatch(argv+1,argc-1,stdout,just_header,hex,direct,recover) ;
 		char *infilename = argv[1] ;
 		if( (fdin = fopen(infilename,"rb")) == NULL )
 		{
 			fprintf(stderr,"Cannot open input file '%s'\n",infilename) ;
 			return 1 ;
 		}
+		char *outfilename = NULL ;
 		if( argc > 2 )	// an outfile is supplied
+			outfilename = argv[2] ;
+		char indexname[FILENAME_MAX] ;
+		if( make_index && outfilename == NULL )	// the index goes next to the input file by default
+		{
+			snprintf(indexname,sizeof(indexname),"%s%s",infilename,SUFFIX_INDEX) ;
+			outfilename = indexname ;
+		}
+		if( outfilename != NULL )
 		{
-			char *outfilename = argv[2] ;
-			if( (fdout = fopen(outfilename,"wt")) == NULL )
+			if( (fdout = fopen(outfilename,make_index ? "wb" : "wt")) == NULL )
 			{
 				fprintf(stderr,"Cannot open output file '%s'\n",outfilename) ;
 				fclose(fdin) ;
@@ -254,7 +766,25 @@ int main(int argc, char *argv[])
 		{
 			fdout = stdout ;
 		}
-		err = rsdump(fdin,fdout,just_header) ;
+		FILE *input = fdin ;
+		if( follow )		// reads the file as it grows, so it can't be compressed
+			err = rsdump_follow(fdin,fdout,just_header,hex) ;
+		else if( direct )
+			err = rsdump_direct(infilename,fdout,just_header,hex,recover) ;
+		else if( filter.active )
+			err = rsdump_select(infilename,fdout,just_header,hex,&filter) ;
+		else if( !make_index && (input = open_decompressed(fdin)) == NULL )	// gzip and xz files are decompressed on the fly
+			err = 1 ;
+		else if( make_index )
+			err = rsindex(fdin,fdout) ;
+		else if( tar )
+			err = rstar(input,fdout,just_header,hex) ;
+		else if( streaming )
+			err = rsdump_stream(input,fdout,just_header,hex) ;
+		else
+			err = rsdump(input,fdout,just_header,hex,recover) ;
+		if( input != NULL && input != fdin )
+			fclose(input) ;
 	}
 	if( strcmp(program_name,"rsgen") == 0 )
 	{
@@ -297,8 +827,28 @@ int check_little_endian(void)	// check whether this code is big or little endian
 
 void usage_rsdump(char *name)
 {
-	fprintf(stderr,"Usage: %s [-h] infile [outfile]\n",name) ;
+	fprintf(stderr,"Usage: %s [-h] [-s] [-i] [-t] [-f] [-d] [-r] [-x] infile [outfile]\n",name) ;
+	fprintf(stderr,"       %s [-h] [-x] [-S first[:last]] [-N first[:last]] [-C channel,...] [-R first[:last]] [-K key,...] infile [outfile]\n",name) ;
+	fprintf(stderr,"       %s -b [-h] [-d] [-r] [-x] infile...\n",name) ;
 	fprintf(stderr,"Processes CODAR SeaSonde RangeSeries data files.\n") ;
+	fprintf(stderr,"  -h  dump the header blocks only\n") ;
+	fprintf(stderr,"  -s  stream the file one block at a time, memory use depends on the largest block\n") ;
+	fprintf(stderr,"  -i  write a sweep index of infile to outfile, or to infile%s, instead of dumping it\n",SUFFIX_INDEX) ;
+	fprintf(stderr,"  -t  infile is a tar archive, dump each RS file in it after a member:name line\n") ;
+	fprintf(stderr,"  -f, --follow  infile is still being written, dump each block once it is complete and stop after the END block\n") ;
+	fprintf(stderr,"  -b  dump many files to stdout, each after a file:name line, reading ahead of the one being dumped\n") ;
+	fprintf(stderr,"  -d  read whole files around the page cache (O_DIRECT), for bulk scans that shouldn't evict other users' data\n") ;
+	fprintf(stderr,"  -r  recover damaged or truncated files, dumping only the intact sweeps, exit status 1 if there was damage\n") ;
+	fprintf(stderr,"  -x  write the I/Q samples and the double fields as C99 hex floats, shorter and faster than decimal, rsgen reads either\n") ;
+	fprintf(stderr,"Selections, which read only what they dump, using the sweep index from -i if it is up to date:\n") ;
+	fprintf(stderr,"  -S first[:last]  dump only these sweeps, counting from 0, and the blocks outside BODY\n") ;
+	fprintf(stderr,"  -N first[:last]  dump only the sweeps with an index from first to last in their indx block\n") ;
+	fprintf(stderr,"  -C channel,...  dump only the samples of these channels in afft and ifft blocks, counting from 0\n") ;
+	fprintf(stderr,"  -R first[:last]  dump only the samples of these range cells in afft and ifft blocks, counting from 0\n") ;
+	fprintf(stderr,"  -K key,...  dump only the blocks with these keys\n") ;
+	fprintf(stderr,"  the dump of a selection is for reading, rsgen cannot rebuild a file from it\n") ;
+	fprintf(stderr,"infile can be compressed with gzip or xz, if this program was built with them\n") ;
+	fprintf(stderr,"Blocks of unknown types are dumped as raw bytes, or as defined in the file named by $%s\n",ENV_BLOCKS) ;
 	fprintf(stderr,"%s\n",Version) ;
 }
 
@@ -307,131 +857,1265 @@ void usage_rsgen(char *name)
 	fprintf(stderr,"Usage: %s infile outfile\n",name) ;
 	fprintf(stderr,"Processes CODAR SeaSonde RangeSeries data files.\n") ;
 	fprintf(stderr,"Reads an ascii text infile and writes a binary version to outfile.\n") ;
+	fprintf(stderr,"Extra block types can be defined in the file named by $%s\n",ENV_BLOCKS) ;
 	fprintf(stderr,"%s\n",Version) ;
 }
 
-int rsdump(FILE *infile, FILE *outfile, int just_header)	// top level function in rsdump mode
-// read the binary file into a buffer
+int rsdump(FILE *infile, FILE *outfile, int just_header, int hex, int recover)	// top level function in rsdump mode
+// map the binary file into memory, or read it into a buffer if it cannot be mapped
 // parse the buffer for RIFF blocks
-// make a linked list of nodes
+// make a table of nodes
 // write a description for each node to a text file
 {
-	fseek(infile,0L,SEEK_END) ;	// seek to the end of the file
-	unsigned long filesize = ftell(infile) ;
-	rewind(infile) ;
-	unsigned char *filedata = malloc(filesize) ;	// try to make a buffer sized to read the entire file
+	if( just_header && !recover )	// the header blocks are a few KB at the front of the file, so read just those rather than the whole file
+		return rsdump_stream(infile,outfile,just_header,hex) ;
+	size_t filesize = 0 ;
+	int mapped = 1 ;
+	unsigned char *filedata = map_binary_file(infile,&filesize) ;	// a regular file is mapped copy-on-write, the parser fixes endianness in place
 	if( filedata == NULL )
 	{
-		fprintf(stderr,"Cannot get memory for file with %ld bytes\n",filesize) ;
-		return 1 ;
+		mapped = 0 ;
+		filedata = load_binary_file(infile,&filesize) ;		// pipes and unmappable files are read into a buffer
+		if( filedata == NULL )
+			return 1 ;
 	}
+	int err = dump_file_data(filedata,filesize,outfile,just_header,hex,recover) ;
+	if( mapped )
+		munmap(filedata,filesize) ;
+	else
+		free(filedata) ;
+	return err ;
+}
+
+int dump_file_data(unsigned char *filedata, size_t filesize, FILE *outfile, int just_header, int hex, int recover)	// parses a whole RS file in memory and dumps it
+// in recovery mode the file is scanned for intact blocks rather than parsed, and damage makes the result 1
+{
 	int err = 0 ;
-	if( read_binary_file(infile,filesize,filedata) == 0 )
+	if( recover || filesize <= sizeof(struct block_header) || check_header(filedata) == 0 )
 	{
-		struct node *list = parse_file(filedata,filesize) ;
-		if( list != NULL )
+		struct node_table table ;
+		memset(&table,0,sizeof(struct node_table)) ;
+		int damaged = 0 ;
+		if( (recover ? parse_recover(&table,filedata,filesize,&damaged) : parse_file(&table,filedata,filesize)) == 0 )
 		{
-			err = dump_list(list,outfile,just_header) ;
-			free_all_nodes(list) ;
+			if( !just_header )		// the header blocks are fixed up as they are dumped
+				fixup_table(&table,filesize) ;
+			struct output out ;
+			err = out_open(&out,outfile,hex) || (just_header ? dump_list(&table,&out,just_header) : render_table(&table,&out,filesize)) ;
+			err |= out_close(&out) ;
 		}
+		else
+			err = 1 ;	// the parser has reported it
+		free_node_table(&table) ;
+		err |= damaged ;
 	}
-	free(filedata) ;
+	else
+		err = 1 ;		// check_header() has reported it
 	return err ;
 }
 
-int rsgen(FILE *infile, FILE *outfile)	// top level function in rsgen mode
-// read lines of text from a text file
-// parse the block key names
-// call the relevant make function to read related data from the text file and make a linked list node for the block
-// write the linked list to a binary RS file
+#define MAX_DEPTH 8	// deepest nesting of superblocks that the streaming parser keeps track of
+
+struct open_block		// a superblock that the streaming parser has entered but not yet finished
 {
-	char line[SIZE_LINE] ;
-	long line_count = 0 ;
+	fourcc key ;			// the superblock's key
+	uint64_t remaining ;		// bytes of the superblock's data block not yet parsed
+} ;
+
+int rsdump_stream(FILE *infile, FILE *outfile, int just_header, int hex)	// top level function in streaming rsdump mode
+// read one RIFF block header at a time
+// keep a stack of the superblocks that are open
+// read each leaf block into a buffer, fix it up, dump it and reuse the buffer for the next block
+{
+	struct open_block stack[MAX_DEPTH] ;
+	int depth = 0 ;
 	struct config config ;
 	memset(&config,0,sizeof(struct config)) ;
-	struct node root ;
-	struct node *list = &root ;
-	memset(list,0,sizeof(struct node)) ;
-	while( fgets(line,SIZE_LINE,infile) )
+	unsigned char *buffer = NULL ;		// holds the current leaf block, grows to the size of the largest block
+	uint64_t buffer_size = 0 ;
+	int err = 0 ;
+	uint64_t position = 0 ;			// offset in the file of the next block header
+	struct node node ;
+	int length ;
+	struct output out ;
+	if( out_open(&out,outfile,hex) )
+		return 1 ;
+	while( err == 0 && (length = read_block_header(infile,&node)) > 0 )
 	{
-		chomp(line,SIZE_LINE) ;				// remove newline
-		if( Debug ) { fprintf(stderr,"debug: chomped line is '%s'\n",line) ; }
-		line_count++ ;
-		if( strlen(line) <= 1 ) continue ;		// skip empty lines
-		if( index(line,':') != NULL ) continue ;	// skip parameter lines
-		fourcc key = *(fourcc *)line ;			// extract the block type
-		endian_fixup(&key,sizeof(key)) ;
-		struct block_functions *block_functions = find_block_functions(key) ;	// returns a set of functions from the Global_functions_dictionary for this block type
-		if( block_functions == NULL )
+		if( position == 0 && node.key != KEY_AQFT )
 		{
-			fprintf(stderr,"Cannot gen block '%s'\n",strkey(key)) ;
-			return 1 ;
+			fprintf(stderr,"Bad header key: %x\n",node.key) ;
+			err = 1 ;
+			break ;
 		}
-		int (*make_function)(struct node *, struct config *, FILE *) = block_functions->make ;
-		int err = (*make_function)(list,&config,infile) ;	// calls the 'make' function from Function_dictionary corresponding to the block type
-		if( err )
+		node.depth = depth ;
+		node.offset = position + length ;
+		if( depth > 0 )		// account for this block in the enclosing superblock
 		{
-			fprintf(stderr,"Error in '%s' block starting at line %ld\n",strkey(key),line_count) ;
-			return 1 ;
+			uint64_t length_left = stack[depth-1].remaining - length ;
+			if( stack[depth-1].remaining < (uint64_t )length )
+				length_left = 0 ;
+			if( node.size > length_left )
+			{
+				fprintf(stderr,"Block '%s' size truncted from %" PRIu64 " to %" PRIu64 " bytes\n",KEYNAME(node.key),node.size,length_left) ;
+				node.size = length_left ;
+			}
+			stack[depth-1].remaining = length_left - node.size ;
 		}
-		if( list->next != NULL ) list = list->next ;	// advance the list pointer to the newly created node
-	}
-	printf("Read %ld lines\n",line_count) ;
-	fixup_sizes(&root) ;	// calculate body, head and aqft block sizes, update nodes
-	// write to outfile
-	int err = rs_write(root.next,outfile) ;
-	free_all_nodes_and_data(list) ;
-	return err ;
-}
-
-int rs_write(struct node *list, FILE *outfile)		// writes a binary RS file using the data from the linked list
-{
-	if( Debug ) { fprintf(stderr,"debug: rs_write: start\n") ; }
-	while( list != NULL )
-	{
-		fourcc key = list->key ;
-		struct block_functions *block_functions = find_block_functions(key) ;	// gets a set of functions from Global_functions_dictionary for this block type
-		if( block_functions == NULL )
+		if( just_header && node.key == KEY_BODY )	// the header is complete, the body is never read
+			break ;
+		if( superblock(node.key) )
 		{
-			fprintf(stderr,"Cannot write block '%s'\n",strkey(list->key)) ;
-			return 1 ;
+			if( depth == MAX_DEPTH )
+			{
+				fprintf(stderr,"Block '%s' is nested too deeply\n",KEYNAME(node.key)) ;
+				err = 1 ;
+				break ;
+			}
+			stack[depth].key = node.key ;
+			stack[depth].remaining = node.size ;
+			depth++ ;
+			position = node.offset ;
 		}
-		int (*gen_function)(struct node *, FILE *) = block_functions->gen ;
-		int err = (*gen_function)(list,outfile) ;	// calls the 'gen' function corresponding to the block type
-		if( err )
+		else
 		{
-			fprintf(stderr,"Error in '%s' block\n",strkey(key)) ;
-			return 1 ;
+			if( node.size > buffer_size )
+			{
+				unsigned char *bigger = realloc(buffer,node.size) ;
+				if( bigger == NULL )
+				{
+					fprintf(stderr,"Cannot get memory for block '%s' with %" PRIu64 " bytes\n",KEYNAME(node.key),node.size) ;
+					err = 1 ;
+					break ;
+				}
+				buffer = bigger ;
+				buffer_size = node.size ;
+			}
+			uint64_t count = fread(buffer,1,node.size,infile) ;
+			if( count != node.size )
+			{
+				fprintf(stderr,"Block '%s' size truncted from %" PRIu64 " to %" PRIu64 " bytes\n",KEYNAME(node.key),node.size,count) ;
+				node.size = count ;
+			}
+			position = node.offset + node.size ;
+			node.data = buffer ;
+			node.bigendian = 1 ;
 		}
-		list = list->next ;
+		err = dump_block(&node,&config,&out) ;
+		while( depth > 0 && stack[depth-1].remaining == 0 )	// close the superblocks that are complete
+			depth-- ;
 	}
-	if( Debug ) { fprintf(stderr,"debug: rs_write: finish\n") ; }
-	return 0 ;
+	err |= out_close(&out) ;
+	free(buffer) ;
+	return err ;
 }
 
-void chomp(char *line, int max)		// delete trailing newline character
-{
-	line[max-1] = '\0' ;
-	char *nl = index(line,0x0a) ;
-	if( nl ) *nl = '\0' ;
-}
+#define FOLLOW_POLL_NS (100*1000*1000)	// how often follow mode checks whether the file has grown, in nanoseconds
 
-int read_parameter(FILE *fd, char format[], void *buffer)	// looks for a line with text to match the given format, copies the value to buffer
+int rsdump_follow(FILE *infile, FILE *outfile, int just_header, int hex)	// top level function in rsdump follow mode
+// like the streaming mode, for a file that the acquisition system is still writing
+// wait until each block header and each data block is complete, then dump it and flush the output
+// walk the headers in file order without using the superblock sizes, which the writer may only set when it closes the file
+// stop after the END block
+// report the time from the write of each new afft block to its output on stderr, taking the file's mtime when the block first appeared as its write time
 {
-	size_t block_start = ftell(fd) ;	// put a finger in the file at the first line of the block
+	int fd = fileno(infile) ;
+	struct stat st ;
+	if( fstat(fd,&st) != 0 || !S_ISREG(st.st_mode) )
+	{
+		fprintf(stderr,"Cannot follow input, it is not a regular file\n") ;
+		return 1 ;
+	}
+	struct config config ;
+	memset(&config,0,sizeof(struct config)) ;
+	unsigned char *buffer = NULL ;		// holds the current leaf block, grows to the size of the largest block
+	uint64_t buffer_size = 0 ;
+	uint64_t position = 0 ;			// offset in the file of the next block header
+	uint64_t initial_size = st.st_size ;	// blocks beyond this were written while we watched
+	uint64_t sweeps = 0 ;			// afft blocks that arrived while following
+	double latency_total = 0 ;
+	double latency_max = 0 ;
 	int err = 0 ;
-	char line[SIZE_LINE] ;
-	if( Debug ) { fprintf(stderr,"debug: read_parameters: format='%s'\n",format) ; }
-	while( fgets(line,SIZE_LINE,fd) )
+	struct node node ;
+	struct output out ;
+	if( out_open(&out,outfile,hex) )
+		return 1 ;
+	while( err == 0 )
 	{
-		chomp(line,SIZE_LINE) ;
-		if( strlen(line) == 0 )
+		unsigned char header[sizeof(struct block_header)+sizeof(uint64_t)] ;
+		size_t length = sizeof(struct block_header) ;
+		if( (err = wait_for_data(fd,position,position+length,&st)) )
+			break ;
+		if( pread(fd,header,length,position) != (ssize_t )length )
 		{
-			fprintf(stderr,"Cannot find parameter '%s'\n",format) ;
+			fprintf(stderr,"Cannot read block header at offset %" PRIu64 "\n",position) ;
 			err = 1 ;
-			break ;			// stop on blank line
+			break ;
 		}
-		if( Debug ) { fprintf(stderr,"debug: read_parameters: line='%s'\n",line) ; }
+		uint32_t size32 ;
+		memcpy(&size32,header+sizeof(fourcc),sizeof(size32)) ;
+		if( size32 == SIZE_EXTENDED )	// the same in either byte order, the real size follows
+		{
+			length += sizeof(uint64_t) ;
+			if( (err = wait_for_data(fd,position,position+length,&st)) )
+				break ;
+			if( pread(fd,header,length,position) != (ssize_t )length )
+			{
+				fprintf(stderr,"Cannot read block header at offset %" PRIu64 "\n",position) ;
+				err = 1 ;
+				break ;
+			}
+		}
+		memset(&node,0,sizeof(struct node)) ;
+		decode_block_header(header,length,&node) ;
+		if( position == 0 && node.key != KEY_AQFT )
+		{
+			fprintf(stderr,"Bad header key: %x\n",node.key) ;
+			err = 1 ;
+			break ;
+		}
+		node.offset = position + length ;
+		if( just_header && node.key == KEY_BODY )	// the header is complete, the body is never read
+			break ;
+		if( superblock(node.key) )	// the first sub-block header follows immediately
+		{
+			position = node.offset ;
+		}
+		else
+		{
+			if( (err = wait_for_data(fd,position,node.offset+node.size,&st)) )
+				break ;
+			if( node.size > buffer_size )
+			{
+				unsigned char *bigger = realloc(buffer,node.size) ;
+				if( bigger == NULL )
+				{
+					fprintf(stderr,"Cannot get memory for block '%s' with %" PRIu64 " bytes\n",KEYNAME(node.key),node.size) ;
+					err = 1 ;
+					break ;
+				}
+				buffer = bigger ;
+				buffer_size = node.size ;
+			}
+			if( pread(fd,buffer,node.size,node.offset) != (ssize_t )node.size )
+			{
+				fprintf(stderr,"Cannot read block '%s' at offset %" PRIu64 "\n",KEYNAME(node.key),node.offset) ;
+				err = 1 ;
+				break ;
+			}
+			position = node.offset + node.size ;
+			node.data = buffer ;
+			node.bigendian = 1 ;
+		}
+		err = dump_block(&node,&config,&out) ;
+		err |= out_flush(&out) ;
+		if( node.key == KEY_afft && position > initial_size )	// the block was written while we watched, so its latency means something
+		{
+			struct timespec now ;
+			clock_gettime(CLOCK_REALTIME,&now) ;
+#if defined(__APPLE__)
+			struct timespec written = st.st_mtimespec ;
+#else
+			struct timespec written = st.st_mtim ;
+#endif
+			double latency = (now.tv_sec - written.tv_sec) + (now.tv_nsec - written.tv_nsec)*1e-9 ;
+			fprintf(stderr,"Sweep block at offset %" PRIu64 " dumped %.3f s after it was written\n",node.offset,latency) ;
+			sweeps++ ;
+			latency_total += latency ;
+			if( latency > latency_max )
+				latency_max = latency ;
+		}
+		if( node.key == KEY_END )
+			break ;
+	}
+	if( sweeps > 0 )
+		fprintf(stderr,"Followed %" PRIu64 " sweeps, latency mean %.3f s, max %.3f s\n",sweeps,latency_total/sweeps,latency_max) ;
+	err |= out_close(&out) ;
+	free(buffer) ;
+	return err ;
+}
+
+int wait_for_data(int fd, uint64_t position, uint64_t end, struct stat *st)	// waits until the file is at least end bytes long
+// st holds the last status of the file and is only refreshed when it is too short, so its mtime is from when the data first appeared
+// returns 1 if the file shrinks below position, which means it was truncated or replaced
+{
+	while( (uint64_t )st->st_size < end )
+	{
+		struct timespec poll = { 0, FOLLOW_POLL_NS } ;
+		nanosleep(&poll,NULL) ;
+		if( fstat(fd,st) != 0 )
+		{
+			fprintf(stderr,"Cannot stat input while following it\n") ;
+			return 1 ;
+		}
+		if( (uint64_t )st->st_size < position )
+		{
+			fprintf(stderr,"Input shrank to %" PRIu64 " bytes while following it at offset %" PRIu64 "\n",(uint64_t )st->st_size,position) ;
+			return 1 ;
+		}
+	}
+	return 0 ;
+}
+
+int read_block_header(FILE *infile, struct node *node)	// reads and decodes the next block header from a stream
+// returns the length of the header, 0 at end of file or -1 if the header is cut short
+{
+	struct block_header header ;
+	size_t count = fread(&header,1,sizeof(struct block_header),infile) ;
+	if( count == 0 )
+		return 0 ;
+	if( count != sizeof(struct block_header) )
+	{
+		fprintf(stderr,"Block header truncated to %zu bytes\n",count) ;
+		return -1 ;
+	}
+	memset(node,0,sizeof(struct node)) ;
+	node->parent = -1 ;
+	endian_fixup(&(header.key),sizeof(header.key)) ;
+	node->key = header.key ;
+	endian_fixup(&(header.size),sizeof(header.size)) ;
+	node->size = header.size ;
+	if( header.size != SIZE_EXTENDED )
+		return sizeof(struct block_header) ;
+	if( fread(&(node->size),sizeof(node->size),1,infile) != 1 )	// the real size follows the header
+	{
+		fprintf(stderr,"Block '%s' extended size is truncated\n",KEYNAME(node->key)) ;
+		return -1 ;
+	}
+	endian_fixup(&(node->size),sizeof(node->size)) ;
+	return sizeof(struct block_header) + sizeof(node->size) ;
+}
+
+const fourcc Global_sweep_keys[NUM_SWEEP_KEYS] = { KEY_indx, KEY_rtag, KEY_gps1, KEY_scal, KEY_afft, KEY_ifft } ;	// the blocks recorded for each sweep in an index
+
+int sweep_key_slot(fourcc key)	// returns the position of key in Global_sweep_keys, or -1 if it isn't a sweep block
+{
+	for( int slot = 0 ; slot < NUM_SWEEP_KEYS ; slot++ )
+	{
+		if( Global_sweep_keys[slot] == key )
+			return slot ;
+	}
+	return -1 ;
+}
+
+int rsindex(FILE *infile, FILE *outfile)	// top level function in rsdump index mode
+// read the block headers one at a time, seeking past each data block
+// start a new sweep entry whenever a sweep block repeats
+// write the offsets and sizes of the sweep blocks to a sidecar index file
+{
+	struct stat st ;
+	if( fstat(fileno(infile),&st) != 0 || !S_ISREG(st.st_mode) )
+	{
+		fprintf(stderr,"Cannot index input, it is not a regular file\n") ;
+		return 1 ;
+	}
+	char header_buffer[SIZE_HEADER_BUFFER] ;		// only the headers are read, so don't fill a large buffer after every seek
+	infile = fdopen(dup(fileno(infile)),"rb") ;		// a private stream, so the small buffer doesn't outlive this function
+	if( infile == NULL )
+	{
+		fprintf(stderr,"Cannot reopen input for indexing\n") ;
+		return 1 ;
+	}
+	setvbuf(infile,header_buffer,_IOFBF,sizeof(header_buffer)) ;
+#ifdef POSIX_FADV_RANDOM
+	posix_fadvise(fileno(infile),0,0,POSIX_FADV_RANDOM) ;	// nor read ahead into the data blocks
+#endif
+	struct sweep_index index ;
+	memset(&index,0,sizeof(struct sweep_index)) ;
+	index.filesize = st.st_size ;
+	index.mtime = st.st_mtime ;
+	uint64_t position = 0 ;			// offset in the file of the next block header
+	struct node node ;
+	int length ;
+	int err = 0 ;
+	while( (length = read_block_header(infile,&node)) > 0 )
+	{
+		if( position == 0 && node.key != KEY_AQFT )
+		{
+			fourcc magic = node.key ;
+			endian_fixup(&magic,sizeof(magic)) ;	// back to file order
+			if( compression_format((unsigned char *)&magic,sizeof(magic)) != COMPRESSION_NONE )
+				fprintf(stderr,"Cannot index compressed input, the offsets must point into the RS file itself\n") ;
+			else
+				fprintf(stderr,"Bad header key: %x\n",node.key) ;
+			err = 1 ;
+			break ;
+		}
+		position += length ;
+		if( superblock(node.key) )	// the first sub-block header follows immediately
+			continue ;
+		if( position + node.size > index.filesize )
+		{
+			fprintf(stderr,"Block '%s' size truncted from %" PRIu64 " to %" PRIu64 " bytes\n",KEYNAME(node.key),node.size,index.filesize-position) ;
+			node.size = index.filesize - position ;
+		}
+		if( add_sweep_block(&index,node.key,position,node.size) )
+		{
+			err = 1 ;
+			break ;
+		}
+		if( fseeko(infile,node.size,SEEK_CUR) != 0 )
+		{
+			fprintf(stderr,"Cannot seek past block '%s'\n",KEYNAME(node.key)) ;
+			err = 1 ;
+			break ;
+		}
+		position += node.size ;
+	}
+	fclose(infile) ;
+	if( length < 0 )
+		err = 1 ;
+	if( err == 0 )
+		err = write_sweep_index(&index,outfile) ;
+	free_sweep_index(&index) ;
+	return err ;
+}
+
+int add_sweep_block(struct sweep_index *index, fourcc key, uint64_t offset, uint64_t size)	// records a block in the index if it is a sweep block
+// a sweep block that the current sweep already has starts the next sweep
+// returns 1 if the index cannot grow
+{
+	int slot = sweep_key_slot(key) ;
+	if( slot < 0 )
+		return 0 ;
+	struct sweep_entry *sweep = index->nsweeps ? &(index->sweeps[index->nsweeps-1]) : NULL ;	// the sweep being filled in
+	if( sweep == NULL || sweep->block[slot].offset != 0 )	// this block belongs to the next sweep
+	{
+		if( index->nsweeps == index->capacity )
+		{
+			uint64_t capacity = index->capacity ? 2*index->capacity : 256 ;
+			struct sweep_entry *bigger = realloc(index->sweeps,capacity*sizeof(struct sweep_entry)) ;
+			if( bigger == NULL )
+			{
+				fprintf(stderr,"Malloc error on sweep index\n") ;
+				return 1 ;
+			}
+			index->sweeps = bigger ;
+			index->capacity = capacity ;
+		}
+		sweep = &(index->sweeps[index->nsweeps++]) ;
+		memset(sweep,0,sizeof(struct sweep_entry)) ;
+	}
+	sweep->block[slot].offset = offset ;
+	sweep->block[slot].size = size ;
+	return 0 ;
+}
+
+int index_mapped_file(unsigned char *file, uint64_t length, struct sweep_index *index)	// builds a sweep index from the block headers of a file in memory
+// only the headers are read, so the data blocks are never paged in
+{
+	memset(index,0,sizeof(struct sweep_index)) ;
+	index->filesize = length ;
+	uint64_t offset = 0 ;
+	struct node node ;
+	while( offset < length )
+	{
+		unsigned int length_header = decode_block_header(file+offset,length-offset,&node) ;
+		if( length_header == 0 )
+			break ;
+		offset += length_header ;
+		if( superblock(node.key) )	// the first sub-block header follows immediately
+			continue ;
+		if( node.size > length - offset )
+		{
+			fprintf(stderr,"Block '%s' size truncted from %" PRIu64 " to %" PRIu64 " bytes\n",KEYNAME(node.key),node.size,length-offset) ;
+			node.size = length - offset ;
+		}
+		if( add_sweep_block(index,node.key,offset,node.size) )
+		{
+			free_sweep_index(index) ;
+			return 1 ;
+		}
+		offset += node.size ;
+	}
+	return 0 ;
+}
+
+int write_sweep_index(struct sweep_index *index, FILE *outfile)	// writes an index as a bigendian header followed by the sweep entries
+{
+	struct index_header header ;
+	header.key = KEY_RSIX ;
+	header.version = INDEX_VERSION ;
+	header.filesize = index->filesize ;
+	header.mtime = index->mtime ;
+	header.nsweeps = index->nsweeps ;
+	endian_fixup(&(header.key),sizeof(header.key)) ;
+	endian_fixup(&(header.version),sizeof(header.version)) ;
+	endian_fixup_bulk8(&(header.filesize),3) ;	// filesize, mtime and nsweeps
+	if( fwrite(&header,sizeof(header),1,outfile) != 1 ) return 1 ;
+	size_t values = index->nsweeps*sizeof(struct sweep_entry)/sizeof(uint64_t) ;
+	endian_fixup_bulk8(index->sweeps,values) ;	// the entries are only made of 64 bit values
+	size_t count = fwrite(index->sweeps,sizeof(struct sweep_entry),index->nsweeps,outfile) ;
+	endian_fixup_bulk8(index->sweeps,values) ;
+	if( count != index->nsweeps )
+	{
+		fprintf(stderr,"Error writing index\n") ;
+		return 1 ;
+	}
+	return 0 ;
+}
+
+int load_sweep_index(char *indexname, FILE *rsfile, struct sweep_index *index)	// reads the index of rsfile, returns 1 if it is missing, unreadable or out of date
+{
+	memset(index,0,sizeof(struct sweep_index)) ;
+	FILE *fd = fopen(indexname,"rb") ;
+	if( fd == NULL )
+		return 1 ;
+	struct index_header header ;
+	int err = 0 ;
+	if( fread(&header,sizeof(header),1,fd) != 1 )
+		err = 1 ;
+	endian_fixup(&(header.key),sizeof(header.key)) ;
+	endian_fixup(&(header.version),sizeof(header.version)) ;
+	endian_fixup_bulk8(&(header.filesize),3) ;	// filesize, mtime and nsweeps
+	if( err == 0 && (header.key != KEY_RSIX || header.version != INDEX_VERSION) )
+	{
+		fprintf(stderr,"Ignoring index '%s', it is not a version %d index\n",indexname,INDEX_VERSION) ;
+		err = 1 ;
+	}
+	struct stat st ;
+	if( err == 0 && fstat(fileno(rsfile),&st) == 0 && (header.filesize != (uint64_t )st.st_size || header.mtime != st.st_mtime) )
+	{
+		fprintf(stderr,"Ignoring index '%s', the file has changed since it was indexed\n",indexname) ;
+		err = 1 ;
+	}
+	if( err == 0 )
+	{
+		index->filesize = header.filesize ;
+		index->mtime = header.mtime ;
+		index->nsweeps = header.nsweeps ;
+		index->sweeps = malloc(header.nsweeps*sizeof(struct sweep_entry)+1) ;
+		if( index->sweeps == NULL || fread(index->sweeps,sizeof(struct sweep_entry),header.nsweeps,fd) != header.nsweeps )
+		{
+			fprintf(stderr,"Ignoring index '%s', it is truncated\n",indexname) ;
+			free_sweep_index(index) ;
+			err = 1 ;
+		}
+		else
+			endian_fixup_bulk8(index->sweeps,index->nsweeps*sizeof(struct sweep_entry)/sizeof(uint64_t)) ;
+	}
+	fclose(fd) ;
+	return err ;
+}
+
+void free_sweep_index(struct sweep_index *index)
+{
+	free(index->sweeps) ;
+	memset(index,0,sizeof(struct sweep_index)) ;
+}
+
+int rstar(FILE *infile, FILE *outfile, int just_header, int hex)	// top level function in rsdump tar mode
+// read the tar header blocks one at a time
+// dump each member whose data starts with the AQFT key, through a stream that ends with the member
+// skip the data of every other member
+{
+	unsigned char header[SIZE_TAR_BLOCK] ;
+	char longname[FILENAME_MAX] = "" ;	// the name of the next member, from a GNU long name or pax header
+	uint64_t longsize = 0 ;			// the size of the next member, from a pax header, 0 if there isn't one
+	uint64_t offset = 0 ;			// offset in the archive of the next header block
+	long members = 0 ;
+	int ended = 0 ;
+	int err = 0 ;
+	while( fread(header,1,SIZE_TAR_BLOCK,infile) == SIZE_TAR_BLOCK )
+	{
+		int empty = 1 ;
+		for( int i = 0 ; i < SIZE_TAR_BLOCK && empty ; i++ )
+			empty = header[i] == 0 ;
+		if( empty )			// the end of archive marker
+		{
+			ended = 1 ;
+			break ;
+		}
+		if( check_tar_header(header) )
+		{
+			fprintf(stderr,"Bad tar header checksum at offset %" PRIu64 "\n",offset) ;
+			return 1 ;
+		}
+		uint64_t size = tar_number(header+124,12) ;
+		char type = header[156] ;
+		if( longsize != 0 && type != 'L' && type != 'x' )
+			size = longsize ;
+		uint64_t padding = (SIZE_TAR_BLOCK - size%SIZE_TAR_BLOCK) % SIZE_TAR_BLOCK ;
+		offset += SIZE_TAR_BLOCK + size + padding ;
+		if( type == 'L' || type == 'x' )	// GNU long name or pax extended header, for the member that follows
+		{
+			if( read_tar_names(infile,size,type,longname,&longsize) || skip_input(infile,padding) )
+			{
+				fprintf(stderr,"Tar archive is truncated\n") ;
+				return 1 ;
+			}
+			continue ;
+		}
+		char name[FILENAME_MAX] ;
+		if( longname[0] != '\0' )
+			snprintf(name,sizeof(name),"%s",longname) ;
+		else if( memcmp(header+257,"ustar",5) == 0 && header[345] != '\0' )	// ustar keeps long paths in a prefix field
+			snprintf(name,sizeof(name),"%.155s/%.100s",(char *)header+345,(char *)header) ;
+		else
+			snprintf(name,sizeof(name),"%.100s",(char *)header) ;
+		longname[0] = '\0' ;
+		longsize = 0 ;
+		uint64_t skip = size + padding ;
+		if( (type == '0' || type == '\0' || type == '7') && size >= sizeof(struct block_header) )	// a regular file
+		{
+			struct tar_member member ;
+			memset(&member,0,sizeof(struct tar_member)) ;
+			member.archive = infile ;
+			member.pending = fread(member.prefix,1,sizeof(member.prefix),infile) ;
+			member.remaining = size - member.pending ;
+			struct block_header aqft ;
+			memcpy(&aqft,member.prefix,sizeof(aqft)) ;
+			endian_fixup(&(aqft.key),sizeof(aqft.key)) ;
+			endian_fixup(&(aqft.size),sizeof(aqft.size)) ;
+			int rsfile = member.pending == sizeof(member.prefix) && aqft.key == KEY_AQFT
+				&& (aqft.size == SIZE_EXTENDED || aqft.size <= size - sizeof(aqft)) ;	// so a text dump, which also starts with "AQFT", isn't taken for an RS file
+			if( rsfile )
+			{
+				if( Debug ) { fprintf(stderr,"debug: rstar: member '%s' with %" PRIu64 " bytes\n",name,size) ; }
+				fprintf(outfile,"member:%s\n",name) ;
+				FILE *stream = open_tar_member(&member) ;
+				if( stream == NULL )
+					return 1 ;
+				if( rsdump_stream(stream,outfile,just_header,hex) )
+				{
+					fprintf(stderr,"Error in tar member '%s'\n",name) ;
+					err = 1 ;	// carry on with the next member
+				}
+				fclose(stream) ;
+				members++ ;
+			}
+			skip = member.remaining + padding ;
+		}
+		if( skip_input(infile,skip) )
+		{
+			fprintf(stderr,"Tar archive is truncated\n") ;
+			return 1 ;
+		}
+	}
+	if( !ended )
+	{
+		fprintf(stderr,"Tar archive is truncated\n") ;
+		err = 1 ;
+	}
+	if( members == 0 )
+		fprintf(stderr,"No RS files found in the tar archive\n") ;
+	return err ;
+}
+
+uint64_t tar_number(unsigned char *field, size_t length)	// decodes a number from a tar header, in octal or in the GNU base-256 form used for large sizes
+{
+	uint64_t value = 0 ;
+	if( field[0] & 0x80 )	// base-256, bigendian, with the top bit as a marker
+	{
+		value = field[0] & 0x3f ;
+		for( size_t i = 1 ; i < length ; i++ )
+			value = (value << 8) | field[i] ;
+		return value ;
+	}
+	for( size_t i = 0 ; i < length && field[i] != '\0' ; i++ )
+	{
+		if( field[i] >= '0' && field[i] <= '7' )
+			value = value*8 + (field[i] - '0') ;
+		else if( field[i] != ' ' )	// leading and trailing spaces are allowed
+			break ;
+	}
+	return value ;
+}
+
+int check_tar_header(unsigned char *header)	// returns 1 if the checksum of a tar header block is wrong
+{
+	uint64_t sum = 0 ;
+	for( int i = 0 ; i < SIZE_TAR_BLOCK ; i++ )
+		sum += ( i >= 148 && i < 156 ) ? ' ' : header[i] ;	// the checksum field counts as spaces
+	return sum != tar_number(header+148,8) ;
+}
+
+int read_tar_names(FILE *infile, uint64_t size, int type, char *longname, uint64_t *longsize)	// reads a GNU long name ('L') or pax ('x') header member
+// copies the name, and for pax the size, that apply to the next member, returns 1 if the archive ends first
+{
+	char buffer[FILENAME_MAX+SIZE_LINE] ;
+	size_t length = size < sizeof(buffer)-1 ? size : sizeof(buffer)-1 ;
+	if( fread(buffer,1,length,infile) != length || skip_input(infile,size-length) )
+		return 1 ;
+	buffer[length] = '\0' ;
+	if( type == 'L' )
+	{
+		snprintf(longname,FILENAME_MAX,"%.*s",FILENAME_MAX-1,buffer) ;
+		return 0 ;
+	}
+	for( char *record = buffer ; record < buffer + length ; )	// pax records are "length key=value\n"
+	{
+		char *end ;
+		long reclen = strtol(record,&end,10) ;
+		if( reclen <= 0 || *end != ' ' || record + reclen > buffer + length )
+			break ;
+		char *value = index(end,'=') ;
+		if( value != NULL && value < record + reclen )
+		{
+			int valuelen = (record + reclen - 1) - (value + 1) ;	// without the newline
+			if( strncmp(end+1,"path=",5) == 0 )
+				snprintf(longname,FILENAME_MAX,"%.*s",valuelen,value+1) ;
+			else if( strncmp(end+1,"size=",5) == 0 )
+				*longsize = strtoull(value+1,NULL,10) ;
+		}
+		record += reclen ;
+	}
+	return 0 ;
+}
+
+ssize_t read_tar_member(void *cookie, char *out, size_t size)	// stdio read function for a stream opened by open_tar_member()
+{
+	struct tar_member *member = cookie ;
+	if( member->position < member->pending )	// replay the bytes used to recognize the member
+	{
+		size_t count = member->pending - member->position ;
+		if( count > size )
+			count = size ;
+		memcpy(out,member->prefix+member->position,count) ;
+		member->position += count ;
+		return count ;
+	}
+	if( size > member->remaining )
+		size = member->remaining ;
+	size_t count = fread(out,1,size,member->archive) ;
+	member->remaining -= count ;
+	return ( count == 0 && ferror(member->archive) ) ? -1 : (ssize_t )count ;
+}
+
+int close_tar_member(void *cookie)	// the member belongs to rstar(), which skips whatever wasn't read
+{
+	(void )cookie ;		// the signature is fixed by fopencookie()
+	return 0 ;
+}
+
+#if !defined(__GLIBC__)
+int read_tar_member_bsd(void *cookie, char *out, int size)	// funopen() wants int sizes
+{
+	return read_tar_member(cookie,out,size) ;
+}
+#endif
+
+FILE *open_tar_member(struct tar_member *member)	// returns a stream that reads the data of one tar member and then ends
+{
+#if defined(__GLIBC__)
+	cookie_io_functions_t functions = { read_tar_member, NULL, NULL, close_tar_member } ;
+	FILE *stream = fopencookie(member,"rb",functions) ;
+#else
+	FILE *stream = funopen(member,read_tar_member_bsd,NULL,NULL,close_tar_member) ;
+#endif
+	if( stream == NULL )
+		fprintf(stderr,"Cannot open a stream for a tar member\n") ;
+	return stream ;
+}
+
+int skip_input(FILE *infile, uint64_t count)	// moves past count bytes of input, by seeking if possible, returns 1 if the input ends first
+{
+	if( count == 0 || fseeko(infile,count,SEEK_CUR) == 0 )
+		return 0 ;
+	char buffer[SIZE_TAR_BLOCK*16] ;
+	while( count > 0 )
+	{
+		size_t length = count < sizeof(buffer) ? count : sizeof(buffer) ;
+		if( fread(buffer,1,length,infile) != length )
+			return 1 ;
+		count -= length ;
+	}
+	return 0 ;
+}
+
+int rsbatch(char **names, int nfiles, FILE *outfile, int just_header, int hex, int direct, int recover)	// top level function in rsdump batch mode
+// keep whole-file reads in flight for up to BATCH_DEPTH files, with io_uring where the kernel has it and reader threads otherwise
+// hand each file to parse_file() and dump it, in the order given, while the files after it are read
+{
+	struct batch batch ;
+	memset(&batch,0,sizeof(struct batch)) ;
+	batch.files = calloc(nfiles,sizeof(struct batch_file)) ;
+	if( batch.files == NULL )
+	{
+		fprintf(stderr,"Malloc error on batch\n") ;
+		return 1 ;
+	}
+	batch.nfiles = nfiles ;
+	batch.recover = recover ;
+	batch.hex = hex ;
+	for( int i = 0 ; i < nfiles ; i++ )
+	{
+		batch.files[i].name = names[i] ;
+		batch.files[i].fd = -1 ;
+		batch.files[i].direct = direct ;
+	}
+	int err = -1 ;
+#ifdef HAVE_IO_URING
+	err = batch_uring(&batch,outfile,just_header) ;
+#endif
+	if( err < 0 )	// io_uring isn't available
+		err = batch_threads(&batch,outfile,just_header) ;
+	free(batch.files) ;
+	return err ;
+}
+
+int rsdump_direct(char *infilename, FILE *outfile, int just_header, int hex, int recover)	// top level function in rsdump direct mode
+// read the whole file with O_DIRECT into an aligned buffer and dump it from there, leaving the page cache as it was
+{
+	struct batch_file file ;
+	memset(&file,0,sizeof(struct batch_file)) ;
+	file.name = infilename ;
+	file.direct = 1 ;
+	if( open_batch_file(&file) || read_batch_file(&file) )
+		return 1 ;
+	int err = 1 ;
+	if( compression_format(file.data,file.size < SIZE_MAGIC ? file.size : SIZE_MAGIC) != COMPRESSION_NONE )
+		fprintf(stderr,"Cannot read compressed input in direct mode, leave out -d\n") ;
+	else
+		err = dump_file_data(file.data,file.size,outfile,just_header,hex,recover) ;
+	free(file.data) ;
+	return err ;
+}
+
+int open_batch_file(struct batch_file *file)	// opens a file and gets a buffer for all of it, returns 1 on an error
+// a direct file is opened with O_DIRECT and read into a buffer aligned for it, so the reads go around the page cache
+// where O_DIRECT isn't supported, by the system or by the filesystem, the file is read normally and its pages are dropped afterwards
+{
+	file->fd = -1 ;
+#ifdef O_DIRECT
+	if( file->direct )
+		file->fd = open(file->name,O_RDONLY|O_DIRECT) ;	// fails with EINVAL on filesystems such as tmpfs
+#endif
+	if( file->fd < 0 )
+		file->fd = open(file->name,O_RDONLY) ;
+#ifdef F_NOCACHE
+	if( file->direct && file->fd >= 0 )
+		fcntl(file->fd,F_NOCACHE,1) ;	// the macOS way
+#endif
+	if( file->fd < 0 )
+	{
+		fprintf(stderr,"Cannot open input file '%s'\n",file->name) ;
+		return 1 ;
+	}
+	struct stat st ;
+	if( fstat(file->fd,&st) != 0 || !S_ISREG(st.st_mode) )
+	{
+		fprintf(stderr,"Cannot read '%s', it is not a regular file\n",file->name) ;
+		close(file->fd) ;
+		file->fd = -1 ;
+		return 1 ;
+	}
+	file->size = st.st_size ;
+	file->span = file->size ;
+	file->done = 0 ;
+	void *data = NULL ;
+	if( file->direct )
+	{
+		file->span = (file->size + DIRECT_ALIGN - 1)/DIRECT_ALIGN*DIRECT_ALIGN ;	// O_DIRECT reads whole blocks, the last one is cut short by the end of the file
+		if( posix_memalign(&data,DIRECT_ALIGN,file->span ? file->span : DIRECT_ALIGN) != 0 )
+			data = NULL ;
+	}
+	else
+	{
+		data = malloc(file->size ? file->size : 1) ;
+	}
+	file->data = data ;
+	if( file->data == NULL )
+	{
+		fprintf(stderr,"Cannot get memory for file with %" PRIu64 " bytes\n",file->size) ;
+		close(file->fd) ;
+		file->fd = -1 ;
+		return 1 ;
+	}
+	return 0 ;
+}
+
+int read_batch_file(struct batch_file *file)	// reads all of an opened file with pread(), returns 1 on an error
+{
+	while( file->done < file->size )
+	{
+		ssize_t count = pread(file->fd,file->data+file->done,batch_read_length(file),file->done) ;
+		if( count < 0 && errno == EINTR )
+			continue ;
+		if( count < 0 )
+		{
+			fprintf(stderr,"Error reading '%s': %s\n",file->name,strerror(errno)) ;
+			break ;
+		}
+		if( count == 0 )	// the file shrank since it was opened
+		{
+			file->size = file->done ;
+			break ;
+		}
+		file->done += count ;
+	}
+	close_batch_file(file) ;
+	if( file->done < file->size )
+	{
+		free(file->data) ;
+		file->data = NULL ;
+		return 1 ;
+	}
+	return 0 ;
+}
+
+uint64_t batch_read_length(struct batch_file *file)	// returns the length of the next read of a file, at most SIZE_BATCH_READ
+{
+	uint64_t length = file->span - file->done ;	// O_DIRECT reads go to the end of the last block
+	if( length > SIZE_BATCH_READ )
+		length = SIZE_BATCH_READ ;
+	return length ;
+}
+
+void close_batch_file(struct batch_file *file)	// closes a file that has been read, dropping its pages from the cache if it is direct
+{
+	int cached = file->direct ;
+#ifdef O_DIRECT
+	if( fcntl(file->fd,F_GETFL) & O_DIRECT )
+		cached = 0 ;		// nothing was cached, and pages other readers had cached are left alone
+#endif
+	if( cached )
+		posix_fadvise(file->fd,0,0,POSIX_FADV_DONTNEED) ;	// O_DIRECT was refused, so drop what the reads brought in
+	close(file->fd) ;
+	file->fd = -1 ;
+}
+
+int dump_batch_file(struct batch_file *file, FILE *outfile, int just_header, int hex, int recover)	// dumps a file that has been read and frees its data
+{
+	if( file->state != BATCH_READ )
+		return 1 ;		// the error has been reported
+	fprintf(outfile,"file:%s\n",file->name) ;
+	int err = 1 ;
+	if( compression_format(file->data,file->size < SIZE_MAGIC ? file->size : SIZE_MAGIC) != COMPRESSION_NONE )	// decompressed into memory, as rs_open() does
+	{
+		FILE *source = fmemopen(file->data,file->size,"rb") ;
+		FILE *stream = NULL ;
+		unsigned char *data = NULL ;
+		size_t size = 0 ;
+		if( source != NULL && (stream = open_decompressed(source)) != NULL )
+		{
+			data = load_binary_file(stream,&size) ;
+			fclose(stream) ;
+		}
+		if( source != NULL )
+			fclose(source) ;
+		if( data != NULL )
+			err = dump_file_data(data,size,outfile,just_header,hex,recover) ;
+		else
+			fprintf(stderr,"Cannot read '%s', it does not decompress to an RS file\n",file->name) ;
+		free(data) ;
+	}
+	else
+		err = dump_file_data(file->data,file->size,outfile,just_header,hex,recover) ;
+	free(file->data) ;
+	file->data = NULL ;
+	return err ;
+}
+
+int batch_threads(struct batch *batch, FILE *outfile, int just_header)	// reads the batch with a pool of reader threads
+{
+	pthread_mutex_init(&(batch->lock),NULL) ;
+	pthread_cond_init(&(batch->changed),NULL) ;
+	pthread_t threads[BATCH_THREADS] ;
+	int nthreads = 0 ;
+	while( nthreads < BATCH_THREADS && pthread_create(&(threads[nthreads]),NULL,batch_reader,batch) == 0 )
+		nthreads++ ;
+	if( Debug ) { fprintf(stderr,"debug: batch_threads: %d reader threads\n",nthreads) ; }
+	int err = 0 ;
+	if( nthreads == 0 )
+	{
+		fprintf(stderr,"Cannot start reader threads\n") ;
+		err = 1 ;
+	}
+	pthread_mutex_lock(&(batch->lock)) ;
+	while( nthreads > 0 && batch->next_dump < batch->nfiles )
+	{
+		struct batch_file *file = &(batch->files[batch->next_dump]) ;
+		while( file->state != BATCH_READ && file->state != BATCH_FAILED )
+			pthread_cond_wait(&(batch->changed),&(batch->lock)) ;
+		pthread_mutex_unlock(&(batch->lock)) ;
+		err |= dump_batch_file(file,outfile,just_header,batch->hex,batch->recover) ;	// the readers carry on meanwhile
+		pthread_mutex_lock(&(batch->lock)) ;
+		batch->next_dump++ ;
+		pthread_cond_broadcast(&(batch->changed)) ;		// there's room to read another file
+	}
+	pthread_mutex_unlock(&(batch->lock)) ;
+	for( int i = 0 ; i < nthreads ; i++ )
+		pthread_join(threads[i],NULL) ;
+	pthread_cond_destroy(&(batch->changed)) ;
+	pthread_mutex_destroy(&(batch->lock)) ;
+	return err ;
+}
+
+void *batch_reader(void *arg)	// reader thread, reads the next file as long as it is within BATCH_DEPTH of the one being dumped
+{
+	struct batch *batch = arg ;
+	pthread_mutex_lock(&(batch->lock)) ;
+	for(;;)
+	{
+		while( batch->next_read < batch->nfiles && batch->next_read >= batch->next_dump + BATCH_DEPTH )
+			pthread_cond_wait(&(batch->changed),&(batch->lock)) ;
+		if( batch->next_read >= batch->nfiles )
+			break ;
+		struct batch_file *file = &(batch->files[batch->next_read++]) ;
+		file->state = BATCH_READING ;
+		pthread_mutex_unlock(&(batch->lock)) ;
+		int err = open_batch_file(file) || read_batch_file(file) ;
+		pthread_mutex_lock(&(batch->lock)) ;
+		file->state = err ? BATCH_FAILED : BATCH_READ ;
+		pthread_cond_broadcast(&(batch->changed)) ;
+	}
+	pthread_mutex_unlock(&(batch->lock)) ;
+	return NULL ;
+}
+
+#ifdef HAVE_IO_URING
+int batch_uring(struct batch *batch, FILE *outfile, int just_header)	// reads the batch with io_uring, returns -1 if the kernel doesn't offer it
+{
+	struct uring ring ;
+	if( uring_setup(&ring,BATCH_DEPTH) )
+		return -1 ;
+	if( Debug ) { fprintf(stderr,"debug: batch_uring: using io_uring\n") ; }
+	int err = 0 ;
+	for( ; batch->next_dump < batch->nfiles ; batch->next_dump++ )
+	{
+		while( batch->next_read < batch->nfiles && batch->next_read < batch->next_dump + BATCH_DEPTH )	// keep BATCH_DEPTH files in flight
+		{
+			struct batch_file *file = &(batch->files[batch->next_read]) ;
+			if( open_batch_file(file) )
+				file->state = BATCH_FAILED ;
+			else
+			{
+				file->state = BATCH_READING ;
+				uring_queue_read(&ring,file,batch->next_read) ;
+			}
+			batch->next_read++ ;
+		}
+		struct batch_file *file = &(batch->files[batch->next_dump]) ;
+		while( file->state == BATCH_READING )
+		{
+			if( uring_enter(&ring,1) )
+				return 1 ;	// reads may still be in flight, so leave their buffers alone
+			uring_reap(&ring,batch) ;
+		}
+		if( ring.to_submit > 0 && uring_enter(&ring,0) )	// start any reads queued while reaping before spending time on the dump
+			return 1 ;
+		err |= dump_batch_file(file,outfile,just_header,batch->hex,batch->recover) ;
+	}
+	uring_close(&ring) ;
+	return err ;
+}
+
+int uring_setup(struct uring *ring, unsigned entries)	// creates an io_uring and maps its rings, returns 1 if the kernel doesn't offer io_uring
+{
+	memset(ring,0,sizeof(struct uring)) ;
+	struct io_uring_params params ;
+	memset(&params,0,sizeof(params)) ;
+	ring->fd = syscall(__NR_io_uring_setup,entries,&params) ;
+	if( ring->fd < 0 )
+	{
+		if( Debug ) { fprintf(stderr,"debug: uring_setup: %s, using threads\n",strerror(errno)) ; }
+		return 1 ;
+	}
+	ring->sq_ring_size = params.sq_off.array + params.sq_entries*sizeof(unsigned) ;
+	ring->cq_ring_size = params.cq_off.cqes + params.cq_entries*sizeof(struct io_uring_cqe) ;
+	int single = params.features & IORING_FEAT_SINGLE_MMAP ;
+	if( single )
+	{
+		if( ring->cq_ring_size > ring->sq_ring_size )
+			ring->sq_ring_size = ring->cq_ring_size ;
+		ring->cq_ring_size = ring->sq_ring_size ;
+	}
+	ring->sqes_size = params.sq_entries*sizeof(struct io_uring_sqe) ;
+	void *sq_ring = mmap(NULL,ring->sq_ring_size,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,ring->fd,IORING_OFF_SQ_RING) ;
+	void *cq_ring = single ? sq_ring : mmap(NULL,ring->cq_ring_size,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,ring->fd,IORING_OFF_CQ_RING) ;
+	void *sqes = mmap(NULL,ring->sqes_size,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,ring->fd,IORING_OFF_SQES) ;
+	ring->sq_ring = sq_ring == MAP_FAILED ? NULL : sq_ring ;
+	ring->cq_ring = cq_ring == MAP_FAILED ? NULL : cq_ring ;
+	ring->sqes = sqes == MAP_FAILED ? NULL : sqes ;
+	if( ring->sq_ring == NULL || ring->cq_ring == NULL || ring->sqes == NULL )
+	{
+		if( Debug ) { fprintf(stderr,"debug: uring_setup: cannot map the rings, using threads\n") ; }
+		uring_close(ring) ;
+		return 1 ;
+	}
+	ring->sq_head = (unsigned *)(ring->sq_ring + params.sq_off.head) ;
+	ring->sq_tail = (unsigned *)(ring->sq_ring + params.sq_off.tail) ;
+	ring->sq_mask = (unsigned *)(ring->sq_ring + params.sq_off.ring_mask) ;
+	ring->sq_array = (unsigned *)(ring->sq_ring + params.sq_off.array) ;
+	ring->cq_head = (unsigned *)(ring->cq_ring + params.cq_off.head) ;
+	ring->cq_tail = (unsigned *)(ring->cq_ring + params.cq_off.tail) ;
+	ring->cq_mask = (unsigned *)(ring->cq_ring + params.cq_off.ring_mask) ;
+	ring->cqes = (struct io_uring_cqe *)(ring->cq_ring + params.cq_off.cqes) ;
+	return 0 ;
+}
+
+void uring_close(struct uring *ring)
+{
+	if( ring->sqes != NULL )
+		munmap(ring->sqes,ring->sqes_size) ;
+	if( ring->cq_ring != NULL && ring->cq_ring != ring->sq_ring )
+		munmap(ring->cq_ring,ring->cq_ring_size) ;
+	if( ring->sq_ring != NULL )
+		munmap(ring->sq_ring,ring->sq_ring_size) ;
+	close(ring->fd) ;
+	memset(ring,0,sizeof(struct uring)) ;
+}
+
+void uring_queue_read(struct uring *ring, struct batch_file *file, int index)	// queues a read of the rest of a file
+// each file has at most one read in flight and at most BATCH_DEPTH files are in flight, so the ring never fills up
+{
+	unsigned tail = *(ring->sq_tail) ;
+	unsigned slot = tail & *(ring->sq_mask) ;
+	struct io_uring_sqe *sqe = &(ring->sqes[slot]) ;
+	uint64_t length = batch_read_length(file) ;
+	file->iov.iov_base = file->data + file->done ;
+	file->iov.iov_len = length ;
+	memset(sqe,0,sizeof(struct io_uring_sqe)) ;
+	sqe->opcode = IORING_OP_READV ;		// rather than IORING_OP_READ, which needs a newer kernel
+	sqe->fd = file->fd ;
+	sqe->addr = (uint64_t )(uintptr_t )&(file->iov) ;
+	sqe->len = 1 ;
+	sqe->off = file->done ;
+	sqe->user_data = index ;
+	ring->sq_array[slot] = slot ;
+	__atomic_store_n(ring->sq_tail,tail+1,__ATOMIC_RELEASE) ;	// the kernel may read the entry as soon as it sees the new tail
+	ring->to_submit++ ;
+}
+
+int uring_enter(struct uring *ring, unsigned wait)	// submits the queued reads and waits for at least wait of them to complete
+{
+	int count ;
+	do
+		count = syscall(__NR_io_uring_enter,ring->fd,ring->to_submit,wait,wait ? IORING_ENTER_GETEVENTS : 0,NULL,0) ;
+	while( count < 0 && errno == EINTR ) ;
+	if( count < 0 )
+	{
+		fprintf(stderr,"Error submitting reads: %s\n",strerror(errno)) ;
+		return 1 ;
+	}
+	ring->to_submit -= count ;
+	return 0 ;
+}
+
+void uring_reap(struct uring *ring, struct batch *batch)	// handles completed reads, queueing the rest of any file that was read short
+{
+	unsigned head = *(ring->cq_head) ;
+	while( head != __atomic_load_n(ring->cq_tail,__ATOMIC_ACQUIRE) )
+	{
+		struct io_uring_cqe *cqe = &(ring->cqes[head & *(ring->cq_mask)]) ;
+		int index = cqe->user_data ;
+		struct batch_file *file = &(batch->files[index]) ;
+		if( cqe->res < 0 )
+		{
+			fprintf(stderr,"Error reading '%s': %s\n",file->name,strerror(-cqe->res)) ;
+			free(file->data) ;
+			file->data = NULL ;
+			file->state = BATCH_FAILED ;
+		}
+		else
+		{
+			file->done += cqe->res ;
+			if( cqe->res == 0 )	// the file shrank since it was opened
+				file->size = file->done ;
+			if( file->done < file->size )
+				uring_queue_read(ring,file,index) ;
+			else
+				file->state = BATCH_READ ;
+		}
+		if( file->state != BATCH_READING )
+			close_batch_file(file) ;
+		head++ ;
+	}
+	__atomic_store_n(ring->cq_head,head,__ATOMIC_RELEASE) ;
+}
+#endif
+
+int rsgen(FILE *infile, FILE *outfile)	// top level function in rsgen mode
+// read lines of text from a text file
+// parse the block key names
+// read the fields of the block named in its schema from the text file and add a node for the block to the table
+// write the table to a binary RS file
+{
+	char line[SIZE_LINE] ;
+	long line_count = 0 ;
+	struct config config ;
+	memset(&config,0,sizeof(struct config)) ;
+	struct node_table table ;
+	memset(&table,0,sizeof(struct node_table)) ;
+	while( fgets(line,SIZE_LINE,infile) )
+	{
+		chomp(line,SIZE_LINE) ;				// remove newline
+		if( Debug ) { fprintf(stderr,"debug: chomped line is '%s'\n",line) ; }
+		line_count++ ;
+		if( strlen(line) <= 1 ) continue ;		// skip empty lines
+		if( index(line,':') != NULL ) continue ;	// skip parameter lines
+		fourcc key = *(fourcc *)line ;			// extract the block type
+		endian_fixup(&key,sizeof(key)) ;
+		const struct block_schema *schema = find_block_schema(key) ;	// returns the layout from Global_block_schemas for this block type
+		if( schema == NULL )
+		{
+			fprintf(stderr,"Cannot gen block '%s'\n",KEYNAME(key)) ;
+			return 1 ;
+		}
+		int err = make_fields(schema,key,&table,&config,infile) ;	// reads the fields of the block, and appends a node
+		if( err )
+		{
+			fprintf(stderr,"Error in '%s' block starting at line %ld\n",KEYNAME(key),line_count) ;
+			free_node_table_and_data(&table) ;
+			return 1 ;
+		}
+	}
+	printf("Read %ld lines\n",line_count) ;
+	fixup_sizes(&table) ;	// calculate body, head and aqft block sizes, update nodes
+	// write to outfile
+	int err = rs_write(&table,outfile) ;
+	free_node_table_and_data(&table) ;
+	return err ;
+}
+
+int rs_write(struct node_table *table, FILE *outfile)		// writes a binary RS file using the data from the table of nodes
+{
+	if( Debug ) { fprintf(stderr,"debug: rs_write: start\n") ; }
+	for( size_t i = 0 ; i < table->count ; i++ )
+	{
+		struct node *node = &(table->nodes[i]) ;
+		fourcc key = node->key ;
+		const struct block_schema *schema = find_block_schema(key) ;	// gets the layout from Global_block_schemas for this block type
+		if( schema == NULL )
+		{
+			fprintf(stderr,"Cannot write block '%s'\n",KEYNAME(node->key)) ;
+			return 1 ;
+		}
+		int err = gen_fields(schema,node,outfile) ;
+		if( err )
+		{
+			fprintf(stderr,"Error in '%s' block\n",KEYNAME(key)) ;
+			return 1 ;
+		}
+	}
+	if( Debug ) { fprintf(stderr,"debug: rs_write: finish\n") ; }
+	return 0 ;
+}
+
+void chomp(char *line, int max)		// delete trailing newline character
+{
+	line[max-1] = '\0' ;
+	char *nl = index(line,0x0a) ;
+	if( nl ) *nl = '\0' ;
+}
+
+int read_parameter(FILE *fd, char format[], void *buffer)	// looks for a line with text to match the given format, copies the value to buffer
+{
+	off_t block_start = ftello(fd) ;	// put a finger in the file at the first line of the block
+	int err = 0 ;
+	char line[SIZE_LINE] ;
+	if( Debug ) { fprintf(stderr,"debug: read_parameters: format='%s'\n",format) ; }
+	while( fgets(line,SIZE_LINE,fd) )
+	{
+		chomp(line,SIZE_LINE) ;
+		if( strlen(line) == 0 )
+		{
+			fprintf(stderr,"Cannot find parameter '%s'\n",format) ;
+			err = 1 ;
+			break ;			// stop on blank line
+		}
+		if( Debug ) { fprintf(stderr,"debug: read_parameters: line='%s'\n",line) ; }
 		int count = sscanf(line,format,buffer) ;
 		if( Debug ) { fprintf(stderr,"debug: read_parameters: sscanf returned %d\n",count) ; }
 		if( count != 0 )
@@ -441,26 +2125,316 @@ int read_parameter(FILE *fd, char format[], void *buffer)	// looks for a line wi
 			break ;
 		}
 	}
-	fseek(fd,block_start,SEEK_SET) ;
+	fseeko(fd,block_start,SEEK_SET) ;
 	return err ;
 }
 
-int read_binary_file(FILE * rsfile, unsigned long filesize, unsigned char *buffer)		// reads the entire binary RS file into memory
+unsigned char *map_binary_file(FILE *rsfile, size_t *filesize)	// maps a regular file privately into memory, returns NULL if it cannot be mapped
+{
+	struct stat st ;
+	if( fstat(fileno(rsfile),&st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0 )
+		return NULL ;
+	void *map = mmap(NULL,st.st_size,PROT_READ|PROT_WRITE,MAP_PRIVATE,fileno(rsfile),0) ;	// private, so in-place endian fixups never reach the file
+	if( map == MAP_FAILED )
+	{
+		if( Debug ) { fprintf(stderr,"debug: map_binary_file: mmap failed, reading instead\n") ; }
+		return NULL ;
+	}
+	madvise(map,st.st_size,MADV_SEQUENTIAL) ;	// the parser walks the file front to back
+	*filesize = st.st_size ;
+	return map ;
+}
+
+#define SIZE_READ_CHUNK (1024*1024)	// buffer growth step when reading from a pipe
+
+unsigned char *load_binary_file(FILE *rsfile, size_t *filesize)	// reads the entire binary RS file into a malloc'd buffer
+{
+	if( fseeko(rsfile,0,SEEK_END) == 0 )	// seekable, so the size is known up front
+	{
+		*filesize = ftello(rsfile) ;
+		rewind(rsfile) ;
+		unsigned char *buffer = malloc(*filesize) ;	// try to make a buffer sized to read the entire file
+		if( buffer == NULL )
+		{
+			fprintf(stderr,"Cannot get memory for file with %zu bytes\n",*filesize) ;
+			return NULL ;
+		}
+		if( read_binary_file(rsfile,*filesize,buffer) )
+		{
+			free(buffer) ;
+			return NULL ;
+		}
+		return buffer ;
+	}
+	unsigned char *buffer = NULL ;		// a pipe, so grow the buffer until end of file
+	size_t size = 0 ;
+	size_t count = 0 ;
+	do{
+		if( count == size )
+		{
+			unsigned char *bigger = realloc(buffer,size+SIZE_READ_CHUNK) ;
+			if( bigger == NULL )
+			{
+				fprintf(stderr,"Cannot get memory for file with more than %zu bytes\n",size) ;
+				free(buffer) ;
+				return NULL ;
+			}
+			buffer = bigger ;
+			size += SIZE_READ_CHUNK ;
+		}
+		count += fread(buffer+count,1,size-count,rsfile) ;
+	}while( !feof(rsfile) && !ferror(rsfile) ) ;
+	if( ferror(rsfile) )
+	{
+		fprintf(stderr,"Error reading rs file after %zu bytes\n",count) ;
+		free(buffer) ;
+		return NULL ;
+	}
+	*filesize = count ;
+	return buffer ;
+}
+
+int read_binary_file(FILE * rsfile, size_t filesize, unsigned char *buffer)		// reads filesize bytes of the binary RS file into memory
 {
-	unsigned long count = fread(buffer,1,filesize,rsfile) ;
+	size_t count = fread(buffer,1,filesize,rsfile) ;
 	if( count != filesize )
 	{
-		fprintf(stderr,"Error reading rs file, only read %lu bytes out of %lu\n",count,filesize) ;
+		fprintf(stderr,"Error reading rs file, only read %zu bytes out of %zu\n",count,filesize) ;
 		return 1 ;
 	}
-	if( count > sizeof(struct block_header) )
+	return 0 ;
+}
+
+int compression_format(unsigned char *magic, size_t count)	// recognizes the start of a gzip or xz file, returns one of the COMPRESSION_ codes
+// count may be less than SIZE_MAGIC, in which case only the bytes given are compared
+{
+	static const unsigned char gzip_magic[] = { 0x1f, 0x8b } ;
+	static const unsigned char xz_magic[] = { 0xfd, '7', 'z', 'X', 'Z', 0x00 } ;
+	if( count >= sizeof(gzip_magic) && memcmp(magic,gzip_magic,sizeof(gzip_magic)) == 0 )
+		return COMPRESSION_GZIP ;
+	if( count >= 4 && memcmp(magic,xz_magic,count < sizeof(xz_magic) ? count : sizeof(xz_magic)) == 0 )
+		return COMPRESSION_XZ ;
+	return COMPRESSION_NONE ;
+}
+
+struct decompressor		// the state behind a stream opened by open_decompressed()
+{
+	FILE *source ;			// the compressed stream, which belongs to the caller
+	int format ;			// one of the COMPRESSION_ codes
+	unsigned char *buffer ;		// compressed bytes read from source, SIZE_DECOMPRESS_BUFFER long
+	size_t pending ;		// bytes at the start of buffer not yet passed on, COMPRESSION_NONE only
+	size_t position ;		// the next of those bytes to pass on
+	int end_of_input ;		// source is exhausted
+	int end_of_stream ;		// the decoder has finished the last compressed stream it started
+#ifdef HAVE_ZLIB
+	z_stream gzip ;
+#endif
+#ifdef HAVE_LZMA
+	lzma_stream xz ;
+#endif
+} ;
+
+ssize_t read_decompressed(void *cookie, char *out, size_t size)	// stdio read function for a stream opened by open_decompressed()
+// returns the number of bytes written to out, 0 at end of file or -1 on an error
+{
+	struct decompressor *d = cookie ;
+	if( d->format == COMPRESSION_NONE )	// replay the bytes used to check the format, then read straight through
+	{
+		if( d->position < d->pending )
+		{
+			size_t count = d->pending - d->position ;
+			if( count > size )
+				count = size ;
+			memcpy(out,d->buffer+d->position,count) ;
+			d->position += count ;
+			return count ;
+		}
+		size_t count = fread(out,1,size,d->source) ;
+		return ( count == 0 && ferror(d->source) ) ? -1 : (ssize_t )count ;
+	}
+#ifdef HAVE_ZLIB
+	if( d->format == COMPRESSION_GZIP )
 	{
-		if( check_header(buffer) )
-			return 1 ;
+		d->gzip.next_out = (unsigned char *)out ;
+		d->gzip.avail_out = size ;
+		while( d->gzip.avail_out > 0 )
+		{
+			if( d->gzip.avail_in == 0 && !d->end_of_input )
+			{
+				d->gzip.next_in = d->buffer ;
+				d->gzip.avail_in = fread(d->buffer,1,SIZE_DECOMPRESS_BUFFER,d->source) ;
+				if( ferror(d->source) )
+					return -1 ;
+				if( d->gzip.avail_in == 0 )
+					d->end_of_input = 1 ;
+			}
+			if( d->gzip.avail_in == 0 && d->end_of_input && d->end_of_stream )
+				break ;
+			int ret = inflate(&(d->gzip),Z_NO_FLUSH) ;	// called even without input, to pass on output that inflate is holding
+			if( ret == Z_STREAM_END )		// the end of one gzip member, another may follow
+			{
+				d->end_of_stream = 1 ;
+				inflateReset(&(d->gzip)) ;
+			}
+			else if( ret == Z_BUF_ERROR )		// no progress, so the input ran out in the middle of a member
+			{
+				fprintf(stderr,"Compressed input is truncated\n") ;
+				d->end_of_stream = 1 ;
+				break ;
+			}
+			else if( ret == Z_DATA_ERROR && d->end_of_stream )	// padding after the last member, as gzip allows
+			{
+				d->gzip.avail_in = 0 ;
+				d->end_of_input = 1 ;
+			}
+			else if( ret != Z_OK )
+			{
+				fprintf(stderr,"Error decompressing gzip input: %s\n",d->gzip.msg ? d->gzip.msg : "unknown error") ;
+				return -1 ;
+			}
+			else
+				d->end_of_stream = 0 ;
+		}
+		return size - d->gzip.avail_out ;
+	}
+#endif
+#ifdef HAVE_LZMA
+	if( d->format == COMPRESSION_XZ )
+	{
+		d->xz.next_out = (unsigned char *)out ;
+		d->xz.avail_out = size ;
+		while( d->xz.avail_out > 0 && !d->end_of_stream )
+		{
+			if( d->xz.avail_in == 0 && !d->end_of_input )
+			{
+				d->xz.next_in = d->buffer ;
+				d->xz.avail_in = fread(d->buffer,1,SIZE_DECOMPRESS_BUFFER,d->source) ;
+				if( ferror(d->source) )
+					return -1 ;
+				if( d->xz.avail_in == 0 )
+					d->end_of_input = 1 ;
+			}
+			lzma_ret ret = lzma_code(&(d->xz),d->end_of_input ? LZMA_FINISH : LZMA_RUN) ;
+			if( ret == LZMA_STREAM_END )	// the decoder handles concatenated xz streams itself
+				d->end_of_stream = 1 ;
+			else if( ret == LZMA_BUF_ERROR )	// no progress, so the input ran out in the middle of a stream
+			{
+				fprintf(stderr,"Compressed input is truncated\n") ;
+				d->end_of_stream = 1 ;
+			}
+			else if( ret != LZMA_OK )
+			{
+				fprintf(stderr,"Error decompressing xz input\n") ;
+				return -1 ;
+			}
+		}
+		return size - d->xz.avail_out ;
 	}
+#endif
+	return -1 ;
+}
+
+int close_decompressed(void *cookie)	// stdio close function for a stream opened by open_decompressed(), leaves the source open
+{
+	struct decompressor *d = cookie ;
+#ifdef HAVE_ZLIB
+	if( d->format == COMPRESSION_GZIP )
+		inflateEnd(&(d->gzip)) ;
+#endif
+#ifdef HAVE_LZMA
+	if( d->format == COMPRESSION_XZ )
+		lzma_end(&(d->xz)) ;
+#endif
+	free(d->buffer) ;
+	free(d) ;
 	return 0 ;
 }
 
+#if !defined(__GLIBC__)
+int read_decompressed_bsd(void *cookie, char *out, int size)	// funopen() wants int sizes
+{
+	return read_decompressed(cookie,out,size) ;
+}
+#endif
+
+FILE *open_decompressed(FILE *infile)	// returns a stream of the decompressed contents of a gzip or xz file, or infile itself if it isn't compressed
+// the caller closes the returned stream if it isn't infile, before closing infile; returns NULL on an error
+{
+	unsigned char magic[SIZE_MAGIC] ;
+	size_t count = fread(magic,1,sizeof(magic),infile) ;
+	int format = compression_format(magic,count) ;
+	if( format == COMPRESSION_NONE && fseeko(infile,0,SEEK_SET) == 0 )	// a plain file, so it can still be mapped
+		return infile ;
+#ifndef HAVE_ZLIB
+	if( format == COMPRESSION_GZIP )
+	{
+		fprintf(stderr,"Cannot read gzip compressed input, rebuild with -DHAVE_ZLIB and -lz\n") ;
+		return NULL ;
+	}
+#endif
+#ifndef HAVE_LZMA
+	if( format == COMPRESSION_XZ )
+	{
+		fprintf(stderr,"Cannot read xz compressed input, rebuild with -DHAVE_LZMA and -llzma\n") ;
+		return NULL ;
+	}
+#endif
+	struct decompressor *d = calloc(1,sizeof(struct decompressor)) ;
+	unsigned char *buffer = malloc(SIZE_DECOMPRESS_BUFFER) ;
+	if( d == NULL || buffer == NULL )
+	{
+		fprintf(stderr,"Malloc error on decompression buffer\n") ;
+		free(d) ;
+		free(buffer) ;
+		return NULL ;
+	}
+	d->source = infile ;
+	d->format = format ;
+	d->buffer = buffer ;
+	memcpy(d->buffer,magic,count) ;		// the bytes already read are the first to decode, or to pass on from a pipe
+	d->pending = count ;
+	int err = 0 ;
+#ifdef HAVE_ZLIB
+	if( format == COMPRESSION_GZIP )
+	{
+		d->gzip.next_in = d->buffer ;
+		d->gzip.avail_in = count ;
+		err = inflateInit2(&(d->gzip),15+16) != Z_OK ;	// 15 bit window, gzip wrapper
+	}
+#endif
+#ifdef HAVE_LZMA
+	if( format == COMPRESSION_XZ )
+	{
+		lzma_stream init = LZMA_STREAM_INIT ;
+		d->xz = init ;
+		d->xz.next_in = d->buffer ;
+		d->xz.avail_in = count ;
+		err = lzma_stream_decoder(&(d->xz),UINT64_MAX,LZMA_CONCATENATED) != LZMA_OK ;
+	}
+#endif
+	if( err )
+	{
+		fprintf(stderr,"Cannot start decompressing input\n") ;
+		free(buffer) ;
+		free(d) ;
+		return NULL ;
+	}
+#if defined(__GLIBC__)
+	cookie_io_functions_t functions = { read_decompressed, NULL, NULL, close_decompressed } ;
+	FILE *stream = fopencookie(d,"rb",functions) ;
+#else
+	FILE *stream = funopen(d,read_decompressed_bsd,NULL,NULL,close_decompressed) ;
+#endif
+	if( stream == NULL )
+	{
+		fprintf(stderr,"Cannot open a stream for decompressed input\n") ;
+		close_decompressed(d) ;
+		return NULL ;
+	}
+	if( Debug ) { fprintf(stderr,"debug: open_decompressed: input format %d\n",format) ; }
+	return stream ;
+}
+
 int check_header(unsigned char *buffer)			// make sure the data in buffer is from an RS file
 {
 	struct block_header *header = (struct block_header *)buffer ;
@@ -476,170 +2450,653 @@ int check_header(unsigned char *buffer)			// make sure the data in buffer is fro
 	return 0 ;
 }
 
-struct node *parse_file(unsigned char *buffer, unsigned long length)	// convert the binary RIFF blocks into a linked list
+int parse_file(struct node_table *table, unsigned char *buffer, uint64_t length)	// convert the binary RIFF blocks into a table of nodes
+{
+	if( parse_block(table,buffer,0,length,0,-1) )	// parses the whole file
+	{
+		fprintf(stderr,"Parser error\n") ;
+		return 1 ;
+	}
+	return 0 ;
+}
+
+int parse_block(struct node_table *table, unsigned char *file, uint64_t offset, uint64_t length, int depth, long parent)		// parser for RIFF blocks, appends a node to the table for each block
+{
+	while( length > 0 )
+	{
+		// make a new node to describe this block
+		struct node *newnode = new_node(table,0) ;
+		if( newnode == NULL )
+			return 1 ;
+		long index = table->count - 1 ;				// newnode moves when the table grows, so remember where it is
+		unsigned int length_header = decode_block_header(file+offset,length,newnode) ;	// copy the key and size from the header, in host order
+		if( length_header == 0 )
+		{
+			table->count-- ;				// drop the node, there's no block to describe
+			return 0 ;
+		}
+		newnode->depth = depth ;
+		newnode->parent = parent ;
+		length -= length_header ;				// reduce the block length by the size of the header
+		offset += length_header ;				// advance past the header
+		if( newnode->size > length )
+		{
+			fprintf(stderr,"Block '%s' size truncted from %" PRIu64 " to %" PRIu64 " bytes\n",KEYNAME(newnode->key),newnode->size,length) ;
+			newnode->size = length ;
+		}
+		newnode->offset = offset ;
+		newnode->data = file + offset ;				// point at the data portion of the block
+		uint64_t size = newnode->size ;
+		if( superblock(newnode->key) )				// if the block is a superblock, recursively parse its data block
+		{
+			if( parse_block(table,file,offset,size,depth+1,index) )
+				return 1 ;
+		}
+		else
+		{
+			newnode->bigendian = 1 ;			// otherwise, the node's data portion needs an endian fixup when it is first used
+		}
+		// move on to the next block in the buffer
+		length -= size ;					// reduce the block length by the size of the data block
+		offset += size ;					// advance past the data block
+	}
+	return 0 ;
+}
+
+unsigned int decode_block_header(unsigned char *buffer, uint64_t length, struct node *node)	// decodes the block header at the start of buffer into node
+// returns the length of the header, or 0 if the header doesn't fit in length bytes
+{
+	if( length < sizeof(struct block_header) )
+	{
+		fprintf(stderr,"Block header truncated to %" PRIu64 " bytes\n",length) ;
+		return 0 ;
+	}
+	struct block_header *header = (struct block_header *)buffer ;	// make buffer contents accessible through struct block_header
+	node->key = header->key ;				// copy the block type, aka key, from the header
+	endian_fixup(&(node->key),sizeof(node->key)) ;		// fixup the endian order
+	uint32_t size32 = header->size ;			// copy the size of the data block (excluding header)
+	endian_fixup(&size32,sizeof(size32)) ;			// fixup the endian order
+	node->size = size32 ;
+	if( size32 != SIZE_EXTENDED )
+		return sizeof(struct block_header) ;
+	if( length < sizeof(struct block_header) + sizeof(node->size) )	// the real size follows the header
+	{
+		fprintf(stderr,"Block '%s' extended size is truncated\n",KEYNAME(node->key)) ;
+		return 0 ;
+	}
+	memcpy(&(node->size),buffer+sizeof(struct block_header),sizeof(node->size)) ;
+	endian_fixup(&(node->size),sizeof(node->size)) ;
+	return sizeof(struct block_header) + sizeof(node->size) ;
+}
+
+unsigned int header_size(uint64_t size)	// returns the number of bytes in the header of a block with the given data size
+{
+	if( size >= SIZE_EXTENDED )
+		return sizeof(struct block_header) + sizeof(uint64_t) ;	// large-file extension
+	return sizeof(struct block_header) ;
+}
+
+unsigned int encode_block_header(struct node *node, unsigned char *buffer)	// puts the RIFF header for a node in buffer, using the large-file extension if needed, returns its length
+{
+	fourcc key = node->key ;
+	endian_fixup(&key,sizeof(key)) ;
+	memcpy(buffer,&key,sizeof(key)) ;
+	uint32_t size32 = node->size < SIZE_EXTENDED ? node->size : SIZE_EXTENDED ;
+	endian_fixup(&size32,sizeof(size32)) ;
+	memcpy(buffer+sizeof(key),&size32,sizeof(size32)) ;
+	if( node->size >= SIZE_EXTENDED )
+	{
+		uint64_t size = node->size ;
+		endian_fixup(&size,sizeof(size)) ;
+		memcpy(buffer+sizeof(struct block_header),&size,sizeof(size)) ;
+	}
+	return header_size(node->size) ;
+}
+
+struct node *new_node(struct node_table *table, fourcc key)	// appends a zeroed node to the table, returns NULL if the table cannot grow
+{
+	if( table->count == table->capacity )
+	{
+		size_t capacity = table->capacity ? 2*table->capacity : 64 ;
+		struct node *nodes = realloc(table->nodes,capacity*sizeof(struct node)) ;
+		if( nodes == NULL )
+		{
+			fprintf(stderr,"Malloc error on node table\n") ;
+			return NULL ;
+		}
+		table->nodes = nodes ;
+		table->capacity = capacity ;
+	}
+	struct node *node = &(table->nodes[table->count++]) ;
+	memset(node,0,sizeof(struct node)) ;
+	node->key = key ;
+	node->parent = -1 ;
+	return node ;
+}
+
+// The fields of each block type's data, in file order, used by the generic functions of the block schema engine.
+// A new block type needs a struct for its data, a list of fields and an entry in Global_block_schemas, or just a line in the file named
+// by $RS_BLOCKS, see load_block_definitions(). All of them are put in Global_registry at startup.
+
+const int Global_field_widths[] =		// the size of each type of field, indexed by its FIELD_ code, or 0 if it is never byte swapped
+{
+	[FIELD_KEY] = sizeof(fourcc),
+	[FIELD_HEX32] = sizeof(uint32_t),
+	[FIELD_UINT32] = sizeof(uint32_t),
+	[FIELD_INT32] = sizeof(int32_t),
+	[FIELD_DOUBLE] = sizeof(double),
+	[FIELD_TEXT] = 0,
+	[FIELD_MACTIME] = sizeof(uint32_t),
+	[FIELD_BYTES] = 0,
+	[FIELD_IQ] = sizeof(float),		// hardcoded type
+} ;
+
+const char *Global_field_type_names[] =		// the name of each type of field in a block definitions file, indexed by its FIELD_ code
+{
+	[FIELD_KEY] = "key",
+	[FIELD_HEX32] = "hex32",
+	[FIELD_UINT32] = "uint32",
+	[FIELD_INT32] = "int32",
+	[FIELD_DOUBLE] = "double",
+	[FIELD_TEXT] = "text",
+	[FIELD_MACTIME] = "mactime",
+	[FIELD_BYTES] = "bytes",
+	[FIELD_IQ] = "iq",
+} ;
+
+const struct block_field Global_sign_fields[] =
+{
+	{ "version", FIELD_KEY, offsetof(struct block_sign,version), 0, NO_CONFIG },
+	{ "filetype", FIELD_KEY, offsetof(struct block_sign,filetype), 0, NO_CONFIG },
+	{ "sitecode", FIELD_KEY, offsetof(struct block_sign,sitecode), 0, NO_CONFIG },
+	{ "userflags", FIELD_HEX32, offsetof(struct block_sign,userflags), 0, NO_CONFIG },
+	{ "description", FIELD_TEXT, offsetof(struct block_sign,description), SIZE_DESCRIPTION, NO_CONFIG },
+	{ "ownername", FIELD_TEXT, offsetof(struct block_sign,ownername), SIZE_OWNERNAME, NO_CONFIG },
+	{ "comment", FIELD_TEXT, offsetof(struct block_sign,comment), SIZE_COMMENT, NO_CONFIG },
+} ;
+
+const struct block_field Global_mcda_fields[] =
+{
+	{ "filetimestamp", FIELD_MACTIME, offsetof(struct block_mcda,filetimestamp), 0, NO_CONFIG },
+} ;
+
+const struct block_field Global_dbrf_fields[] =
+{
+	{ "rxloss", FIELD_DOUBLE, offsetof(struct block_dbrf,rxloss), 4, NO_CONFIG },
+} ;
+
+const struct block_field Global_cnst_fields[] =
+{
+	{ "nchannels", FIELD_INT32, offsetof(struct block_cnst,nchannels), 0, NO_CONFIG },
+	{ "nranges", FIELD_INT32, offsetof(struct block_cnst,nranges), 0, NO_CONFIG },
+	{ "nsweeps", FIELD_INT32, offsetof(struct block_cnst,nsweeps), 0, NO_CONFIG },
+	{ "iqindicator", FIELD_INT32, offsetof(struct block_cnst,iqindicator), 0, NO_CONFIG },
+} ;
+
+const struct block_field Global_hasi_fields[] =
+{
+	{ "data", FIELD_BYTES, 0, 0, NO_CONFIG },		// unknown structure, kept as raw bytes
+} ;
+
+const struct block_field Global_swep_fields[] =
+{
+	{ "samplespersweep", FIELD_INT32, offsetof(struct block_swep,samplespersweep), 0, NO_CONFIG },
+	{ "sweepstart", FIELD_DOUBLE, offsetof(struct block_swep,sweepstart), 20, NO_CONFIG },
+	{ "sweepbandwidth", FIELD_DOUBLE, offsetof(struct block_swep,sweepbandwidth), 20, NO_CONFIG },
+	{ "sweeprate", FIELD_DOUBLE, offsetof(struct block_swep,sweeprate), 20, NO_CONFIG },
+	{ "rangeoffset", FIELD_INT32, offsetof(struct block_swep,rangeoffset), 0, NO_CONFIG },
+} ;
+
+const struct block_field Global_fbin_fields[] =
+{
+	{ "format", FIELD_KEY, offsetof(struct block_fbin,bin_format), 0, offsetof(struct config,bin_format) },	// remember this for body data blocks
+	{ "type", FIELD_KEY, offsetof(struct block_fbin,bin_type), 0, offsetof(struct config,bin_type) },
+} ;
+
+const struct block_field Global_rtag_fields[] =
+{
+	{ "rtag", FIELD_UINT32, offsetof(struct block_rtag,rtag), 0, NO_CONFIG },
+} ;
+
+const struct block_field Global_gps1_fields[] =
+{
+	{ "lat", FIELD_DOUBLE, offsetof(struct block_gps1,lat), 6, NO_CONFIG },
+	{ "lon", FIELD_DOUBLE, offsetof(struct block_gps1,lon), 6, NO_CONFIG },
+	{ "alt", FIELD_DOUBLE, offsetof(struct block_gps1,alt), 6, NO_CONFIG },
+	{ "gpstimestamp", FIELD_MACTIME, offsetof(struct block_gps1,gpstimestamp), 0, NO_CONFIG },
+} ;
+
+const struct block_field Global_indx_fields[] =
+{
+	{ "index", FIELD_UINT32, offsetof(struct block_indx,index), 0, offsetof(struct config,index) },
+} ;
+
+const struct block_field Global_scal_fields[] =
+{
+	{ "scalar_one", FIELD_DOUBLE, offsetof(struct block_scal,scalar_one), 20, offsetof(struct config,scalar_one) },
+	{ "scalar_two", FIELD_DOUBLE, offsetof(struct block_scal,scalar_two), 20, offsetof(struct config,scalar_two) },
+} ;
+
+const struct block_field Global_afft_fields[] =
+{
+	{ "iqdata", FIELD_IQ, 0, 0, NO_CONFIG },
+} ;
+
+const struct block_field Global_ifft_fields[] =
+{
+	{ "iqdata", FIELD_IQ, 0, 0, NO_CONFIG },
+} ;
+
+#define FIELDS(list) list, sizeof(list)/sizeof(list[0])	// the fields and the number of fields for an entry in Global_block_schemas
+
+const struct block_schema Global_block_schemas[] =		// a list of RIFF keys and the layout of their blocks, used to lookup how to handle a block
+{
+	{ KEY_AQFT, SCHEMA_SUPERBLOCK, 0, NULL, 0 },
+	{ KEY_HEAD, SCHEMA_SUPERBLOCK, 0, NULL, 0 },
+	{ KEY_sign, 0, sizeof(struct block_sign), FIELDS(Global_sign_fields) },
+	{ KEY_mcda, 0, sizeof(struct block_mcda), FIELDS(Global_mcda_fields) },
+	{ KEY_dbrf, 0, sizeof(struct block_dbrf), FIELDS(Global_dbrf_fields) },
+	{ KEY_cnst, 0, sizeof(struct block_cnst), FIELDS(Global_cnst_fields) },
+	{ KEY_hasi, 0, sizeof(struct block_hasi), FIELDS(Global_hasi_fields) },
+	{ KEY_swep, 0, sizeof(struct block_swep), FIELDS(Global_swep_fields) },
+	{ KEY_fbin, 0, sizeof(struct block_fbin), FIELDS(Global_fbin_fields) },
+	{ KEY_BODY, SCHEMA_SUPERBLOCK, 0, NULL, 0 },
+	{ KEY_rtag, 0, sizeof(struct block_rtag), FIELDS(Global_rtag_fields) },
+	{ KEY_gps1, 0, sizeof(struct block_gps1), FIELDS(Global_gps1_fields) },
+	{ KEY_indx, 0, sizeof(struct block_indx), FIELDS(Global_indx_fields) },
+	{ KEY_scal, 0, sizeof(struct block_scal), FIELDS(Global_scal_fields) },
+	{ KEY_afft, 0, sizeof(struct block_iqdata_float), FIELDS(Global_afft_fields) },		// hardcoded type
+	{ KEY_ifft, 0, sizeof(struct block_iqdata_float), FIELDS(Global_ifft_fields) },		// hardcoded type
+	{ KEY_END, SCHEMA_LAST, 0, NULL, 0 },		// no data, and no blank line after it in the text version
+	{ 0, 0, 0, NULL, 0 }
+} ;
+
+const struct block_field Global_raw_fields[] =
+{
+	{ "data", FIELD_BYTES, 0, 0, NO_CONFIG },
+} ;
+
+const struct block_schema Global_raw_schema = { 0, 0, 0, FIELDS(Global_raw_fields) } ;	// used for any key that is not registered, the data passes through as raw bytes
+
+struct block_registry Global_registry ;		// filled in by init_block_registry(), read-only after that
+
+static inline unsigned int hash_key(fourcc key)	// returns the registry slot where the search for key starts
+{
+	return (uint32_t )(key * 0x9e3779b1U) >> (32 - REGISTRY_BITS) ;	// multiplicative hashing, the top bits depend on every byte of the key
+}
+
+const struct block_schema *lookup_block_schema(fourcc key)	// returns the registered schema for key, or NULL without complaining if there is none
+{
+	for( unsigned int slot = hash_key(key) ; Global_registry.slots[slot] != NULL ; slot = (slot + 1) & (REGISTRY_SIZE - 1) )
+	{
+		if( Global_registry.slots[slot]->key == key )
+			return Global_registry.slots[slot] ;
+	}
+	return NULL ;
+}
+
+const struct block_schema *find_block_schema(fourcc key)	// returns the schema for the given RIFF key, an unknown key gets the raw schema
+{
+	if( key == 0 )
+	{
+		fprintf(stderr,"Bad key (zero!)\n") ;
+		return NULL ;
+	}
+	const struct block_schema *schema = lookup_block_schema(key) ;
+	if( schema == NULL )
+	{
+		if( Debug ) { fprintf(stderr,"debug: find_block_schema: unknown key '%s', passing the data through\n",KEYNAME(key)) ; }
+		return &Global_raw_schema ;
+	}
+	return schema ;
+}
+
+int register_block_schema(const struct block_schema *schema)	// adds a schema to Global_registry, returns 1 if its key is taken or the registry is full
+{
+	if( lookup_block_schema(schema->key) != NULL )
+	{
+		fprintf(stderr,"Block '%s' is already defined\n",KEYNAME(schema->key)) ;
+		return 1 ;
+	}
+	if( Global_registry.count == MAX_BLOCK_TYPES )
+	{
+		fprintf(stderr,"Too many block types, at most %d can be defined\n",MAX_BLOCK_TYPES) ;
+		return 1 ;
+	}
+	unsigned int slot = hash_key(schema->key) ;
+	while( Global_registry.slots[slot] != NULL )
+		slot = (slot + 1) & (REGISTRY_SIZE - 1) ;
+	Global_registry.slots[slot] = schema ;
+	Global_registry.schemas[Global_registry.count++] = schema ;
+	return 0 ;
+}
+
+int init_block_registry(void)	// registers the built-in blocks and those defined in the file named by $RS_BLOCKS, only the first call does anything
+{
+	if( Global_registry.count > 0 )
+		return 0 ;
+	for( const struct block_schema *schema = Global_block_schemas ; schema->key != 0 ; schema++ )
+	{
+		if( register_block_schema(schema) )
+			return 1 ;
+	}
+	char *filename = getenv(ENV_BLOCKS) ;
+	if( filename != NULL && filename[0] != '\0' )
+		return load_block_definitions(filename) ;
+	return 0 ;
+}
+
+int load_block_definitions(char *filename)	// registers the blocks defined in a text file, returns 1 on any error
+// each line is a 4 character key and then its fields in file order, as name:type or name:type:count, separated by spaces
+// the types are the names in Global_field_type_names, count is the length of a text field or the digits after the point for a double field
+// a bytes or iq field takes the rest of the block, so it must come last, blank lines and lines starting with # are skipped
+// for example:    wind speed:double:2 direction:int32 time:mactime
 {
-	struct node dummy_root ;	// use a dummy root node to prime the parser
-	if( parse_block(&dummy_root,buffer,length) )	// parses the whole file
+	FILE *fd = fopen(filename,"rt") ;
+	if( fd == NULL )
 	{
-		fprintf(stderr,"Parser error\n") ;
-		return NULL ;
+		fprintf(stderr,"Cannot open block definitions file '%s'\n",filename) ;
+		return 1 ;
+	}
+	char line[SIZE_LINE] ;
+	int line_count = 0 ;
+	int err = 0 ;
+	while( err == 0 && fgets(line,SIZE_LINE,fd) )
+	{
+		line_count++ ;
+		chomp(line,SIZE_LINE) ;
+		char *saveptr = NULL ;
+		char *keyname = strtok_r(line," \t",&saveptr) ;
+		if( keyname == NULL || keyname[0] == '#' )
+			continue ;
+		err = define_block(keyname,&saveptr) ;
+		if( err )
+			fprintf(stderr,"Error in block definitions file '%s' at line %d\n",filename,line_count) ;
 	}
-	return dummy_root.next ;	// return the next node as the true root
+	fclose(fd) ;
+	if( Debug ) { fprintf(stderr,"debug: load_block_definitions: %d block types known after reading '%s'\n",Global_registry.count,filename) ; }
+	return err ;
 }
 
-int parse_block(struct node *root, unsigned char *buffer, unsigned long length)		// parser for RIFF blocks, builds the linked list
+int define_block(char *keyname, char **saveptr)	// registers a block with the given key, taking its fields from the rest of the line being split by strtok_r
 {
-	while( length > 0 )
+	if( strlen(keyname) != sizeof(fourcc) )
 	{
-		// make a new node to describe this block
-		struct node *newnode = malloc(sizeof(struct node)) ;
-		if( newnode == NULL )
+		fprintf(stderr,"Block key '%s' must have 4 characters\n",keyname) ;
+		return 1 ;
+	}
+	fourcc key ;
+	memcpy(&key,keyname,sizeof(key)) ;
+	endian_fixup(&key,sizeof(key)) ;
+	struct block_field fields[MAX_FIELDS] ;
+	int nfields = 0 ;
+	size_t offset = 0 ;
+	size_t size = 0 ;
+	for( char *arg = strtok_r(NULL," \t",saveptr) ; arg != NULL ; arg = strtok_r(NULL," \t",saveptr) )
+	{
+		if( nfields == MAX_FIELDS )
 		{
-			fprintf(stderr,"Malloc error\n") ;
+			fprintf(stderr,"Block '%s' has more than %d fields\n",keyname,MAX_FIELDS) ;
 			return 1 ;
 		}
-		memset(newnode,0,sizeof(struct node)) ;
-		root->next = newnode ;					// link the previous node to the new node
-		struct block_header *header = (struct block_header *)buffer ;	// make buffer contents accessible through struct block_header
-		endian_fixup(&(header->key),sizeof(newnode->key)) ;	// fixup the endian order
-		newnode->key = header->key ;				// copy the block type, aka key, from the header
-		endian_fixup(&(header->size),sizeof(newnode->size)) ;	// fixup the endian order
-		newnode->size = header->size ;				// copy the size of the data block (excluding header)
-		length -= sizeof(struct block_header) ;			// reduce the block length by the size of the header
-		buffer += sizeof(struct block_header) ;			// advance the buffer pointer by the size of the header
-		if( newnode->size > length )
+		if( nfields > 0 && (fields[nfields-1].type == FIELD_BYTES || fields[nfields-1].type == FIELD_IQ) )
 		{
-			fprintf(stderr,"Block '%s' size truncted from %u to %lu bytes\n",strkey(newnode->key),newnode->size,length) ;
-			newnode->size = length ;
+			fprintf(stderr,"Field '%s' of block '%s' follows a field that takes the rest of the block\n",arg,keyname) ;
+			return 1 ;
 		}
-		newnode->data = buffer ;				// point at the data portion of the block
-		if( superblock(newnode->key) )				// if the block is a superblock, recursively parse its data block
+		char *fieldsave = NULL ;
+		char *name = arg[0] != ':' ? strtok_r(arg,":",&fieldsave) : NULL ;	// strtok_r() would skip the colon and take the type for the name
+		if( name == NULL || name[0] == '\0' )
 		{
-			if( parse_block(newnode,newnode->data,newnode->size) )
-				return 1 ;
+			fprintf(stderr,"Field '%s' of block '%s' has no name\n",arg,keyname) ;
+			return 1 ;
 		}
-		else
+		char *typename = strtok_r(NULL,":",&fieldsave) ;
+		char *countname = strtok_r(NULL,":",&fieldsave) ;
+		int type = -1 ;
+		for( int t = 0 ; typename != NULL && t < (int )(sizeof(Global_field_type_names)/sizeof(Global_field_type_names[0])) ; t++ )
 		{
-			if( fixup_block(newnode) )			// otherwise, the node's data portion just needs an endian fixup
-				;
-				//return 1 ;				// continue on error
+			if( strcmp(typename,Global_field_type_names[t]) == 0 )
+				type = t ;
 		}
-		// move on to the next block in the buffer
-		length -= newnode->size ;				// reduce the block length by the size of the data block
-		buffer += newnode->size ;				// advance the buffer pointer by the size of the data block
-		do{							// iterate to deal with recursive parsing
-			root = root->next ;				// advance the root pointer to the new node, ready to iterate
-		}while( root->next != NULL ) ;
+		if( type < 0 )
+		{
+			fprintf(stderr,"Field '%s' of block '%s' has no known type\n",name,keyname) ;
+			return 1 ;
+		}
+		int count = countname != NULL ? atoi(countname) : 6 ;		// 6 digits after the point, like %lf
+		if( (type == FIELD_TEXT && (countname == NULL || count <= 0)) || count < 0 )
+		{
+			fprintf(stderr,"Field '%s' of block '%s' needs a length\n",name,keyname) ;
+			return 1 ;
+		}
+		struct block_field *field = &(fields[nfields++]) ;
+		field->name = strdup(name) ;
+		if( field->name == NULL )
+		{
+			fprintf(stderr,"Malloc error on block definitions\n") ;
+			return 1 ;
+		}
+		field->type = type ;
+		field->offset = offset ;
+		field->count = count ;
+		field->config = NO_CONFIG ;
+		if( type == FIELD_TEXT )
+			offset += count ;
+		else if( type != FIELD_BYTES && type != FIELD_IQ )
+			offset += Global_field_widths[type] ;
+		size = type == FIELD_IQ ? offset + sizeof(struct block_iqdata_float) : offset ;	// at least one sample		// hardcoded type
 	}
-	return 0 ;
-}
-
-struct block_functions Global_function_dictionary[] =		// a list of RIFF keys and associated functions, used to lookup which function to call
-{
-	{ KEY_AQFT, fixup_data_aqft, make_node_aqft, dump_block_aqft, gen_block_aqft  },
-	{ KEY_HEAD, fixup_data_head, make_node_head, dump_block_head, gen_block_head  },
-	{ KEY_sign, fixup_data_sign, make_node_sign, dump_block_sign, gen_block_sign  },
-	{ KEY_mcda, fixup_data_mcda, make_node_mcda, dump_block_mcda, gen_block_mcda  },
-	{ KEY_dbrf, fixup_data_dbrf, make_node_dbrf, dump_block_dbrf, gen_block_dbrf  },
-	{ KEY_cnst, fixup_data_cnst, make_node_cnst, dump_block_cnst, gen_block_cnst  },
-	{ KEY_hasi, fixup_data_hasi, make_node_hasi, dump_block_hasi, gen_block_hasi  },
-	{ KEY_swep, fixup_data_swep, make_node_swep, dump_block_swep, gen_block_swep  },
-	{ KEY_fbin, fixup_data_fbin, make_node_fbin, dump_block_fbin, gen_block_fbin  },
-	{ KEY_BODY, fixup_data_body, make_node_body, dump_block_body, gen_block_body  },
-	{ KEY_rtag, fixup_data_rtag, make_node_rtag, dump_block_rtag, gen_block_rtag  },
-	{ KEY_gps1, fixup_data_gps1, make_node_gps1, dump_block_gps1, gen_block_gps1  },
-	{ KEY_indx, fixup_data_indx, make_node_indx, dump_block_indx, gen_block_indx  },
-	{ KEY_scal, fixup_data_scal, make_node_scal, dump_block_scal, gen_block_scal  },
-	{ KEY_afft, fixup_data_afft, make_node_afft, dump_block_afft, gen_block_afft  },
-	{ KEY_ifft, fixup_data_ifft, make_node_ifft, dump_block_ifft, gen_block_ifft  },
-	{ KEY_END, fixup_data_end, make_node_end, dump_block_end, gen_block_end  },
-	{ 0, NULL, NULL, NULL, NULL }
-} ;
-
-struct block_functions *find_block_functions(fourcc key)	// search for the given RIFF key in the list of keys/functions, return a struct of functions
-{
-	if( key == 0 )
+	if( nfields == 0 )
 	{
-		fprintf(stderr,"Bad key (zero!)\n") ;
-		return NULL ;
+		fprintf(stderr,"Block '%s' has no fields\n",keyname) ;
+		return 1 ;
 	}
-	for( struct block_functions *block_functions = Global_function_dictionary ; block_functions->key != 0 ; block_functions++ )
+	struct block_schema *schema = malloc(sizeof(struct block_schema)) ;
+	struct block_field *copy = malloc(nfields*sizeof(struct block_field)) ;	// kept for the whole run, like the built-in schemas
+	if( schema == NULL || copy == NULL )
 	{
-		if( key == block_functions->key )
-			return block_functions ;
+		fprintf(stderr,"Malloc error on block definitions\n") ;
+		free(schema) ;
+		free(copy) ;
+		return 1 ;
 	}
-	fprintf(stderr,"Cannot locate functions for key '%s'\n",strkey(key)) ;
-	return NULL ;
+	memcpy(copy,fields,nfields*sizeof(struct block_field)) ;
+	schema->key = key ;
+	schema->flags = 0 ;
+	schema->size = size ;
+	schema->fields = copy ;
+	schema->nfields = nfields ;
+	if( Debug ) { fprintf(stderr,"debug: define_block: '%s' has %d fields, size %zu\n",keyname,nfields,size) ; }
+	return register_block_schema(schema) ;
 }
 
-int fixup_block(struct node *node)	// calls the fixup function that is associated with the given node's RIFF key
+int fixup_block(struct node *node)	// swaps the byte order of a node's data block, following the schema for its RIFF key
 {
-	struct block_functions *block_functions = find_block_functions(node->key) ;	// returns a set of functions from the Global_functions_dictionary for this block type
-	if( block_functions == NULL )
+	const struct block_schema *schema = find_block_schema(node->key) ;	// returns the layout from Global_block_schemas for this block type
+	if( schema == NULL )
 	{
-		fprintf(stderr,"Cannot fixup block '%s'\n",strkey(node->key)) ;
+		fprintf(stderr,"Cannot fixup block '%s'\n",KEYNAME(node->key)) ;
 		return 1 ;
 	}
-	int (*fixup_function)(struct node *) = block_functions->fixup ;
-	int err = (*fixup_function)(node) ;	// calls the fixup function corresponding to the block key
-	if( err )
+	if( node->size < schema->size )
 	{
-		fprintf(stderr,"Error fixing block %s\n",strkey(node->key)) ;
+		fprintf(stderr,"Block '%s' is truncated\n",KEYNAME(node->key)) ;
+		fprintf(stderr,"Error fixing block %s\n",KEYNAME(node->key)) ;
 		return 1 ;
 	}
+	swap_fields(schema,node->data,node->size) ;
+	return 0 ;
+}
+
+int fixup_node(struct node *node)	// fixes up the endian order of a node's data block the first time it is needed, later calls do nothing
+{
+	if( !node->bigendian )
+		return 0 ;
+	node->bigendian = 0 ;		// only ever try once, a failed fixup leaves a truncated block to be reported by its consumer
+	return fixup_block(node) ;
+}
+
+int fixup_table(struct node_table *table, uint64_t length)	// fixes up the byte order of every block of a parsed file of length bytes, on all cores
+// the parser only walks the block headers, and the blocks in BODY are independent, so their data can be fixed up in any order
+// errors are left for the dump functions to report, as with fixup_node()
+{
+	long ncores = sysconf(_SC_NPROCESSORS_ONLN) ;
+	if( length < FIXUP_PARALLEL_MIN || ncores < 2 )
+		return 0 ;		// not worth the threads, dump_block() fixes each block as it goes
+	int nthreads = ncores < FIXUP_THREADS_MAX ? ncores : FIXUP_THREADS_MAX ;
+	struct fixup_work work ;
+	work.table = table ;
+	work.next = 0 ;
+	pthread_t threads[FIXUP_THREADS_MAX] ;
+	int started = 0 ;
+	while( started < nthreads-1 && pthread_create(&(threads[started]),NULL,fixup_worker,&work) == 0 )
+		started++ ;
+	if( Debug ) { fprintf(stderr,"debug: fixup_table: %d threads for %zu nodes\n",started+1,table->count) ; }
+	fixup_worker(&work) ;		// this thread takes a share too, and does it all if no thread could be started
+	for( int i = 0 ; i < started ; i++ )
+		pthread_join(threads[i],NULL) ;
 	return 0 ;
 }
 
-void endian_fixup(void *original, int size)	// performs byte swapping if needed, as determined by the global endian flag
+void *fixup_worker(void *arg)	// fixup thread, claims FIXUP_CHUNK nodes at a time until none are left
 {
-	if( Global_flag_little_endian )
+	struct fixup_work *work = arg ;
+	struct node_table *table = work->table ;
+	for(;;)
 	{
-		unsigned char tmp[8] ;
-		memcpy(tmp,original,size) ;	// uses a temporary copy
-		swapcopy(original,tmp,size) ;
+		size_t first = __atomic_fetch_add(&(work->next),FIXUP_CHUNK,__ATOMIC_RELAXED) ;
+		if( first >= table->count )
+			break ;
+		size_t last = first + FIXUP_CHUNK < table->count ? first + FIXUP_CHUNK : table->count ;
+		for( size_t count = first ; count < last ; count++ )
+			fixup_node(&(table->nodes[count])) ;	// superblocks and fixed blocks are skipped
 	}
+	return NULL ;
 }
 
-void swapcopy(unsigned char *dest, unsigned char *source, int size)	// swaps bytes according to the size of the object
+static inline void endian_fixup(void *original, int size)	// swaps the bytes of a 2, 4 or 8 byte value in place, if this code is little endian
 {
-	switch( size )
+	if( !HOST_LITTLE_ENDIAN )
+		return ;		// already in file order, this compiles away on a big endian host
+	switch( size )		// size is a sizeof() at every call, so only one case survives inlining
 	{
 		case 2:
-			swapcopy2(dest,source) ;
+		{
+			uint16_t value ;
+			memcpy(&value,original,sizeof(value)) ;	// memcpy because fields of packed structs can be unaligned
+			value = __builtin_bswap16(value) ;
+			memcpy(original,&value,sizeof(value)) ;
+		}
 		break ;
 		case 4:
-			swapcopy4(dest,source) ;
+		{
+			uint32_t value ;
+			memcpy(&value,original,sizeof(value)) ;
+			value = __builtin_bswap32(value) ;
+			memcpy(original,&value,sizeof(value)) ;
+		}
 		break ;
 		case 8:
-			swapcopy8(dest,source) ;
+		{
+			uint64_t value ;
+			memcpy(&value,original,sizeof(value)) ;
+			value = __builtin_bswap64(value) ;
+			memcpy(original,&value,sizeof(value)) ;
+		}
 		break ;
 	}
 }
 
-void swapcopy2(unsigned char *dest, unsigned char *source)
+static inline void endian_fixup_bulk4(void *original, size_t count)	// performs byte swapping of an array of 4 byte values in place, if needed
 {
-	dest[0] = source[1] ;
-	dest[1] = source[0] ;
+	if( HOST_LITTLE_ENDIAN )
+		swapbulk4(original,count) ;
 }
 
-void swapcopy4(unsigned char *dest, unsigned char *source)
+static inline void endian_fixup_bulk8(void *original, size_t count)	// performs byte swapping of an array of 8 byte values in place, if needed
 {
-	dest[0] = source[3] ;
-	dest[1] = source[2] ;
-	dest[2] = source[1] ;
-	dest[3] = source[0] ;
+	if( HOST_LITTLE_ENDIAN )
+		swapbulk8(original,count) ;
 }
 
-void swapcopy8(unsigned char *dest, unsigned char *source)
+// The bulk swaps use the widest shuffle the compiler is allowed to emit (build with -mavx2 or -mssse3 to get more than SSE2),
+// then finish the last few values one at a time.
+
+void swapbulk4(unsigned char *data, size_t count)	// reverses the bytes of count 4 byte values in place
+{
+	size_t length = count*4 ;
+	size_t i = 0 ;
+#if defined(__AVX2__)
+	const __m256i mask32 = _mm256_setr_epi8(3,2,1,0,7,6,5,4,11,10,9,8,15,14,13,12,3,2,1,0,7,6,5,4,11,10,9,8,15,14,13,12) ;
+	for( ; i+32 <= length ; i += 32 )
+	{
+		__m256i v = _mm256_loadu_si256((__m256i *)(data+i)) ;
+		_mm256_storeu_si256((__m256i *)(data+i),_mm256_shuffle_epi8(v,mask32)) ;
+	}
+#endif
+#if defined(__SSSE3__)
+	const __m128i mask16 = _mm_setr_epi8(3,2,1,0,7,6,5,4,11,10,9,8,15,14,13,12) ;
+	for( ; i+16 <= length ; i += 16 )
+	{
+		__m128i v = _mm_loadu_si128((__m128i *)(data+i)) ;
+		_mm_storeu_si128((__m128i *)(data+i),_mm_shuffle_epi8(v,mask16)) ;
+	}
+#elif defined(__SSE2__)
+	for( ; i+16 <= length ; i += 16 )
+	{
+		__m128i v = _mm_loadu_si128((__m128i *)(data+i)) ;
+		v = _mm_or_si128(_mm_slli_epi16(v,8),_mm_srli_epi16(v,8)) ;		// swap the bytes in each 16 bit half
+		v = _mm_shufflelo_epi16(v,_MM_SHUFFLE(2,3,0,1)) ;			// then swap the halves
+		v = _mm_shufflehi_epi16(v,_MM_SHUFFLE(2,3,0,1)) ;
+		_mm_storeu_si128((__m128i *)(data+i),v) ;
+	}
+#endif
+	for( ; i < length ; i += 4 )
+	{
+		uint32_t value ;
+		memcpy(&value,data+i,4) ;
+		value = __builtin_bswap32(value) ;
+		memcpy(data+i,&value,4) ;
+	}
+}
+
+void swapbulk8(unsigned char *data, size_t count)	// reverses the bytes of count 8 byte values in place
 {
-	dest[0] = source[7] ;
-	dest[1] = source[6] ;
-	dest[2] = source[5] ;
-	dest[3] = source[4] ;
-	dest[4] = source[3] ;
-	dest[5] = source[2] ;
-	dest[6] = source[1] ;
-	dest[7] = source[0] ;
+	size_t length = count*8 ;
+	size_t i = 0 ;
+#if defined(__AVX2__)
+	const __m256i mask32 = _mm256_setr_epi8(7,6,5,4,3,2,1,0,15,14,13,12,11,10,9,8,7,6,5,4,3,2,1,0,15,14,13,12,11,10,9,8) ;
+	for( ; i+32 <= length ; i += 32 )
+	{
+		__m256i v = _mm256_loadu_si256((__m256i *)(data+i)) ;
+		_mm256_storeu_si256((__m256i *)(data+i),_mm256_shuffle_epi8(v,mask32)) ;
+	}
+#endif
+#if defined(__SSSE3__)
+	const __m128i mask16 = _mm_setr_epi8(7,6,5,4,3,2,1,0,15,14,13,12,11,10,9,8) ;
+	for( ; i+16 <= length ; i += 16 )
+	{
+		__m128i v = _mm_loadu_si128((__m128i *)(data+i)) ;
+		_mm_storeu_si128((__m128i *)(data+i),_mm_shuffle_epi8(v,mask16)) ;
+	}
+#elif defined(__SSE2__)
+	for( ; i+16 <= length ; i += 16 )
+	{
+		__m128i v = _mm_loadu_si128((__m128i *)(data+i)) ;
+		v = _mm_or_si128(_mm_slli_epi16(v,8),_mm_srli_epi16(v,8)) ;		// swap the bytes in each 16 bit quarter
+		v = _mm_shufflelo_epi16(v,_MM_SHUFFLE(0,1,2,3)) ;			// then reverse the quarters
+		v = _mm_shufflehi_epi16(v,_MM_SHUFFLE(0,1,2,3)) ;
+		_mm_storeu_si128((__m128i *)(data+i),v) ;
+	}
+#endif
+	for( ; i < length ; i += 8 )
+	{
+		uint64_t value ;
+		memcpy(&value,data+i,8) ;
+		value = __builtin_bswap64(value) ;
+		memcpy(data+i,&value,8) ;
+	}
 }
 
 int superblock(fourcc key)	// returns 1 if the RIFF key denotes a 'superblock', i.e. one that is composed of sub-blocks
@@ -688,1520 +3145,2234 @@ void debugdump(unsigned char *buffer, int n)	// prettyprint hexascii for debug p
 	}
 }
 
-#define MAX_NAME 10
-char Global_name[MAX_NAME] ;
-char *strkey(fourcc name)		// converts a RIFF key to a string, with byte-swapping. Relies on a global variable.
+char *strkey(fourcc name, char *buffer)		// converts a RIFF key to a string in buffer, which holds SIZE_KEYNAME bytes, with byte-swapping
 {
-	int size = sizeof(name) ;
-	if( size >= MAX_NAME )
-		size = MAX_NAME-1 ;
-	memcpy(Global_name,(void *)&name,size) ;
-	endian_fixup(Global_name,size) ;
-	Global_name[size] = '\0' ;
-	return Global_name ;
+	memcpy(buffer,(void *)&name,sizeof(name)) ;
+	endian_fixup(buffer,sizeof(name)) ;
+	buffer[sizeof(name)] = '\0' ;
+	return buffer ;
 }
 
-int fixup_sizes(struct node *list)	// updates the various block size counts from the data in the linked list
+int fixup_sizes(struct node_table *table)	// updates the various block size counts from the data in the table
 {
-	uint32_t head_size = calculate_head_size(list) ;
+	uint64_t head_size = calculate_head_size(table) ;
 	if( head_size == 0 ) return 1 ;
-	uint32_t body_size = calculate_body_size(list) ;
+	uint64_t body_size = calculate_body_size(table) ;
 	if( body_size == 0 ) return 1 ;
-	uint32_t aqft_size = head_size + sizeof(struct block_header) + body_size + sizeof(struct block_header) ;
-	if( set_block_size(list,KEY_AQFT,aqft_size) ) return 1 ;
-	if( set_block_size(list,KEY_HEAD,head_size) ) return 1 ;
-	if( set_block_size(list,KEY_BODY,body_size) ) return 1 ;
+	uint64_t aqft_size = head_size + header_size(head_size) + body_size + header_size(body_size) ;
+	if( set_block_size(table,KEY_AQFT,aqft_size) ) return 1 ;
+	if( set_block_size(table,KEY_HEAD,head_size) ) return 1 ;
+	if( set_block_size(table,KEY_BODY,body_size) ) return 1 ;
 	return 0 ;
 }
 
-uint32_t calculate_body_size(struct node *list)			// returns the size of the blocks in the BODY superblock
+uint64_t calculate_body_size(struct node_table *table)			// returns the size of the blocks in the BODY superblock
 {
 	int in_body = 0 ;
-	uint32_t size = 0 ;
-	while( list != NULL )
+	uint64_t size = 0 ;
+	for( struct node *node = table->nodes ; node < table->nodes + table->count ; node++ )
 	{
-		if( list->key == KEY_END )
+		if( node->key == KEY_END )
 			in_body = 0 ;
 		if( in_body )
-			size += ( list->size + sizeof(struct block_header) ) ;	// remember to count the block header
-		if( list->key == KEY_BODY )
+			size += ( node->size + header_size(node->size) ) ;	// remember to count the block header
+		if( node->key == KEY_BODY )
 			in_body = 1 ;
-		list = list->next ;
-	} ;
+	}
 	return size ;
 }
 
-uint32_t calculate_head_size(struct node *list)			// returns the size of the blocks in the HEAD superblock
+uint64_t calculate_head_size(struct node_table *table)			// returns the size of the blocks in the HEAD superblock
 {
 	int in_head = 0 ;
-	uint32_t size = 0 ;
-	while( list != NULL )
+	uint64_t size = 0 ;
+	for( struct node *node = table->nodes ; node < table->nodes + table->count ; node++ )
 	{
-		if( list->key == KEY_END )
+		if( node->key == KEY_END )
 			in_head = 0 ;
-		if( list->key == KEY_BODY )
+		if( node->key == KEY_BODY )
 			in_head = 0 ;
 		if( in_head )
-			size += (list->size + sizeof(struct block_header) ) ;	// remember to count the block header
-		if( list->key == KEY_HEAD )
+			size += (node->size + header_size(node->size) ) ;	// remember to count the block header
+		if( node->key == KEY_HEAD )
 			in_head = 1 ;
-		list = list->next ;
-	} ;
+	}
 	return size ;
 }
 
-int set_block_size(struct node *list, fourcc key, uint32_t size)	// searches the linked list for a given RIFF key to update the size data
+int set_block_size(struct node_table *table, fourcc key, uint64_t size)	// searches the table for a given RIFF key to update the size data
 {
-	while( list != NULL )
+	for( struct node *node = table->nodes ; node < table->nodes + table->count ; node++ )
 	{
-		if( list->key == key )
+		if( node->key == key )
 		{
-			list->size = size ;
+			node->size = size ;
 			return 0 ;
 		}
-		list = list->next ;
 	}
 	return 1 ;	// returns 1 for failure, 0 for success
 }
 
-void show_list(struct node *list)	// show the linked list, for debugging
+void show_table(struct node_table *table)	// show the table of nodes, for debugging
 {
-	unsigned int count = 0 ;
-	while( list != NULL )
+	for( size_t count = 0 ; count < table->count ; count++ )
 	{
-		printf("Node %u: key %.4s size %u\n",count,(char *)&(list->key),list->size) ;
-		list = list->next ;
-		count++ ;
+		struct node *node = &(table->nodes[count]) ;
+		printf("Node %zu: key %.4s size %" PRIu64 " offset %" PRIu64 " depth %d parent %ld\n",count,(char *)&(node->key),node->size,node->offset,node->depth,node->parent) ;
 	}
 }
 
-int dump_list(struct node *list, FILE *outfile, int just_header) // goes through the list of nodes, writing an ascii text description of each node to outfile
+int dump_list(struct node_table *table, struct output *out, int just_header) // goes through the table of nodes, writing an ascii text description of each node to out
 {
-	unsigned int count = 0 ;
 	struct config config ;
 	memset(&config,0,sizeof(struct config)) ;
-	while( list != NULL )
+	for( struct node *node = table->nodes ; node < table->nodes + table->count ; node++ )
 	{
-		if( Debug ) { fprintf(stderr,"debug: dump_list: node has key '%s'\n",strkey(list->key)) ; }
-		struct block_functions *block_functions = find_block_functions(list->key) ;	// returns a set of functions from the Global_functions_dictionary for this block key
-		if( block_functions == NULL )
-		{
-			fprintf(stderr,"Cannot dump block '%s'\n",strkey(list->key)) ;
+		if( just_header && node->key == KEY_BODY ) return 0 ;
+		if( dump_block(node,&config,out) )
 			return 1 ;
-		}
-		int (*dump_function)(struct node *, struct config *, FILE *) = block_functions->dump ;	// extract the dump function
-		if( just_header && dump_function == dump_block_body ) return 0 ;
-		int err = (*dump_function)(list,&config,outfile) ;	// calls the dump function
-		if( err )
-		{
-			fprintf(stderr,"Error dumping block '%s'\n",strkey(list->key)) ;
-			return 1 ;
-		}
-		list = list->next ;
 	}
 	return 0 ;
 }
 
-
-// Start of the block-specific functions.
-// For each block type there are four functions: fixup_data_xxxx, dump_block_xxxx, make_node_xxxx and gen_block_xxxx.
-// The function fixup_data_xxxx performs endian fixup on data read from a binary RIFF. Used in rsdump mode.
-// The function dump_block_xxxx writes a text version of a block from a linked list node. Used in rsdump mode.
-// The function make_node_xxxx reads a text version of the block and makes a linked list node. Used in rsgen mode.
-// The function gen_block_xxxx writes a binary RIFF block from a linked list node. Used in rsgen mode.
-
-
-int fixup_data_aqft(struct node *node)
-{
-	return 0 ;
-}
-
-int dump_block_aqft(struct node *node, struct config *config, FILE *outfile)
-{
-	fprintf(outfile,"%s\n",strkey(KEY_AQFT)) ;
-	fprintf(outfile,"\n") ;
-	return 0 ;
-}
-
-int make_node_aqft(struct node *list, struct config *config, FILE *fd)		// creates a new node for AQFT block, fd not used
+int dump_block(struct node *node, struct config *config, struct output *out)	// writes the text version of a node, following the schema for its RIFF key
 {
-	struct node *newnode = malloc(sizeof(struct node)) ;
-	if( newnode == NULL )
+	if( Debug ) { fprintf(stderr,"debug: dump_block: node has key '%s'\n",KEYNAME(node->key)) ; }
+	const struct block_schema *schema = find_block_schema(node->key) ;	// returns the layout from Global_block_schemas for this block key
+	if( schema == NULL )
 	{
-		fprintf(stderr,"Malloc error\n") ;
+		fprintf(stderr,"Cannot dump block '%s'\n",KEYNAME(node->key)) ;
 		return 1 ;
 	}
-	memset(newnode,0,sizeof(struct node)) ;
-	list->next = newnode ;
-	newnode->key = KEY_AQFT ;
-	// fixup size at the very end
-	// no explicit data block, it's composed of sub blocks
-	return 0 ;
-}
-
-int gen_block_aqft(struct node *node, FILE *outfile)
-{
-	endian_fixup(&(node->key),sizeof(node->key)) ;
-	if( fwrite(&(node->key),sizeof(node->key),1,outfile) != 1 ) return 1 ;
-	endian_fixup(&(node->size),sizeof(node->size)) ;
-	if( fwrite(&(node->size),sizeof(node->size),1,outfile) != 1 ) return 1 ;
-	return 0 ;
-}
-
-
-int fixup_data_head(struct node *node)
-{
-	return 0 ;
-}
-
-int dump_block_head(struct node *node, struct config *config, FILE *outfile)
-{
-	fprintf(outfile,"%s\n",strkey(KEY_HEAD)) ;
-	fprintf(outfile,"\n") ;
-	return 0 ;
-}
-
-int make_node_head(struct node *list, struct config *config, FILE *fd)
-{
-	struct node *newnode = malloc(sizeof(struct node)) ;
-	if( newnode == NULL )
+	fixup_node(node) ;					// continue on error, dump_fields reports a truncated block
+	int err = dump_fields(schema,node,config,out) ;
+	if( err )
 	{
-		fprintf(stderr,"Malloc error\n") ;
+		fprintf(stderr,"Error dumping block '%s'\n",KEYNAME(node->key)) ;
 		return 1 ;
 	}
-	memset(newnode,0,sizeof(struct node)) ;
-	list->next = newnode ;
-	newnode->key = KEY_HEAD ;
-	// fixup size at the very end
-	// no explicit data block, it's composed of sub blocks
-	return 0 ;
-}
-
-int gen_block_head(struct node *node, FILE *outfile)
-{
-	endian_fixup(&(node->key),sizeof(node->key)) ;
-	if( fwrite(&(node->key),sizeof(node->key),1,outfile) != 1 ) return 1 ;
-	endian_fixup(&(node->size),sizeof(node->size)) ;
-	if( fwrite(&(node->size),sizeof(node->size),1,outfile) != 1 ) return 1 ;
 	return 0 ;
 }
 
-
-struct block_sign				// contains only the data portion for this type of block, i.e. no header data (key, size)
-{
-	fourcc version ;			// file version
-	fourcc filetype ;			// file type
-	fourcc sitecode ; 			// owner code
-	uint32_t userflags ;			// user flags
-	char description[SIZE_DESCRIPTION] ;	// file description
-	char ownername[SIZE_OWNERNAME] ;	// owner name
-	char comment[SIZE_COMMENT] ;		// comment
-} __attribute__((packed)) ;	// make sure there's no padding
-
-int fixup_data_sign(struct node *node)
+int render_table(struct node_table *table, struct output *out, uint64_t length)	// dumps the table of nodes like dump_list(), rendering the text of a large file on all cores
+// the only state carried from block to block is the config, so a serial pass over the nodes notes the config at the start of each chunk,
+// then the threads render the chunks into their own buffers and this thread writes the buffers in file order, giving the same text as dump_list()
+// the pass stops at the first block that dump_fields() would refuse, which is then dumped here after the rest, so its errors are reported as before
 {
-	if( node->size < sizeof(struct block_sign) )
+	long ncores = sysconf(_SC_NPROCESSORS_ONLN) ;
+	if( length < RENDER_PARALLEL_MIN || ncores < 2 )
+		return dump_list(table,out,0) ;
+	struct render_work work ;
+	memset(&work,0,sizeof(struct render_work)) ;
+	work.table = table ;
+	size_t stop ;
+	struct config config ;
+	if( plan_render(table,&work.chunks,&work.nchunks,&stop,&config) )
+		return 1 ;
+	int nthreads = ncores < RENDER_THREADS_MAX ? ncores : RENDER_THREADS_MAX ;
+	work.nslots = (size_t )nthreads*RENDER_WINDOW ;
+	work.slots = calloc(work.nslots,sizeof(struct render_slot)) ;
+	if( work.slots == NULL )
 	{
-		fprintf(stderr,"Block '%s' is truncated\n",strkey(KEY_sign)) ;
+		fprintf(stderr,"Cannot get memory for %zu output buffers\n",work.nslots) ;
+		free(work.chunks) ;
 		return 1 ;
 	}
-	struct block_sign *sign = (struct block_sign *)(node->data) ;
-	endian_fixup(&(sign->version),sizeof(sign->version)) ;
-	endian_fixup(&(sign->filetype),sizeof(sign->filetype)) ;
-	endian_fixup(&(sign->sitecode),sizeof(sign->sitecode)) ;
-	endian_fixup(&(sign->userflags),sizeof(sign->userflags)) ;
-	return 0 ;
+	int err = 0 ;
+	for( size_t i = 0 ; i < work.nslots ; i++ )
+		err |= out_open(&(work.slots[i].out),NULL,out->hex) ;
+	pthread_mutex_init(&(work.lock),NULL) ;
+	pthread_cond_init(&(work.rendered),NULL) ;
+	pthread_cond_init(&(work.freed),NULL) ;
+	pthread_t threads[RENDER_THREADS_MAX] ;
+	int started = 0 ;
+	while( err == 0 && started < nthreads && pthread_create(&(threads[started]),NULL,render_worker,&work) == 0 )
+		started++ ;
+	if( Debug ) { fprintf(stderr,"debug: render_table: %d threads for %zu chunks\n",started,work.nchunks) ; }
+	int serial = err == 0 && started == 0 ;		// no thread could be started, nothing has been written yet
+	if( serial )
+		err = 1 ;
+	for( size_t chunk = 0 ; err == 0 && chunk < work.nchunks ; chunk++ )	// write the chunks in order as they become ready
+	{
+		struct render_slot *slot = &(work.slots[chunk % work.nslots]) ;
+		pthread_mutex_lock(&(work.lock)) ;
+		while( !slot->ready )
+			pthread_cond_wait(&(work.rendered),&(work.lock)) ;
+		pthread_mutex_unlock(&(work.lock)) ;
+		err = slot->err ;
+		if( err == 0 )
+			out_text(out,slot->out.data,slot->out.length) ;
+		err |= out->err ;
+		slot->out.length = 0 ;
+		pthread_mutex_lock(&(work.lock)) ;
+		slot->ready = 0 ;
+		work.written++ ;
+		pthread_cond_broadcast(&(work.freed)) ;
+		pthread_mutex_unlock(&(work.lock)) ;
+	}
+	pthread_mutex_lock(&(work.lock)) ;
+	work.failed = err ;
+	pthread_cond_broadcast(&(work.freed)) ;
+	pthread_mutex_unlock(&(work.lock)) ;
+	for( int i = 0 ; i < started ; i++ )
+		pthread_join(threads[i],NULL) ;
+	pthread_cond_destroy(&(work.freed)) ;
+	pthread_cond_destroy(&(work.rendered)) ;
+	pthread_mutex_destroy(&(work.lock)) ;
+	for( size_t i = 0 ; i < work.nslots ; i++ )
+		free(work.slots[i].out.data) ;
+	free(work.slots) ;
+	free(work.chunks) ;
+	if( serial )
+		return dump_list(table,out,0) ;
+	if( err == 0 && stop < table->count )		// dump_list() would have stopped at this block
+		err = dump_block(&(table->nodes[stop]),&config,out) ;
+	return err ;
 }
 
-int dump_block_sign(struct node *node, struct config *config, FILE *outfile)
+int plan_render(struct node_table *table, struct render_chunk **chunks, size_t *nchunks, size_t *stop, struct config *config)	// splits the nodes into chunks for render_table(), returns 1 on an error
+// each chunk starts with the config that dump_list() would have there, stop is set to the first node that cannot be dumped and config to the config for it
 {
-	if( node->size < sizeof(struct block_sign) )
+	size_t capacity = 0 ;
+	uint64_t chunk_size = RENDER_CHUNK_SIZE ;	// so the first node starts a chunk
+	*chunks = NULL ;
+	*nchunks = 0 ;
+	memset(config,0,sizeof(struct config)) ;
+	size_t count ;
+	for( count = 0 ; count < table->count ; count++ )
 	{
-		fprintf(stderr,"Block '%s' is truncated\n",strkey(KEY_sign)) ;
-		return 1 ;
+		struct node *node = &(table->nodes[count]) ;
+		if( node->key == 0 )		// find_block_schema() refuses it
+			break ;
+		const struct block_schema *schema = find_block_schema(node->key) ;
+		fixup_node(node) ;		// already done by fixup_table() unless this is the only core
+		if( check_fields(schema,node,config,0) )
+			break ;
+		if( chunk_size >= RENDER_CHUNK_SIZE )
+		{
+			if( *nchunks == capacity )
+			{
+				capacity = capacity ? capacity*2 : 64 ;
+				struct render_chunk *bigger = realloc(*chunks,capacity*sizeof(struct render_chunk)) ;
+				if( bigger == NULL )
+				{
+					fprintf(stderr,"Cannot get memory for %zu chunks of output\n",capacity) ;
+					free(*chunks) ;
+					return 1 ;
+				}
+				*chunks = bigger ;
+			}
+			if( *nchunks > 0 )
+				(*chunks)[*nchunks-1].last = count ;
+			(*chunks)[*nchunks].first = count ;
+			(*chunks)[*nchunks].config = *config ;
+			(*nchunks)++ ;
+			chunk_size = 0 ;
+		}
+		if( !superblock(node->key) )
+			chunk_size += node->size ;
+		take_config(schema,node,config) ;
 	}
-	struct block_sign *sign = (struct block_sign *)(node->data) ;
-	fprintf(outfile,"%s\n",strkey(KEY_sign)) ;
-	fprintf(outfile,"version:%s\n",strkey(sign->version)) ;
-	fprintf(outfile,"filetype:%s\n",strkey(sign->filetype)) ;
-	fprintf(outfile,"sitecode:%s\n",strkey(sign->sitecode)) ;
-	fprintf(outfile,"userflags:%x\n",sign->userflags) ;
-	fprintf(outfile,"description:%.*s\n",SIZE_DESCRIPTION,sign->description) ;
-	fprintf(outfile,"ownername:%.*s\n",SIZE_OWNERNAME,sign->ownername) ;
-	fprintf(outfile,"comment:%.*s\n",SIZE_OWNERNAME,sign->comment) ;
-	fprintf(outfile,"\n") ;
+	if( *nchunks > 0 )
+		(*chunks)[*nchunks-1].last = count ;
+	*stop = count ;
 	return 0 ;
 }
 
-int make_node_sign(struct node *list, struct config *config, FILE *fd)
+void *render_worker(void *arg)	// render thread, claims the next chunk once its slot is free and renders it into the slot
 {
-	struct node *newnode = malloc(sizeof(struct node)) ;
-	if( newnode == NULL )
-	{
-		fprintf(stderr,"Malloc error on list node\n") ;
-		return 1 ;
-	}
-	memset(newnode,0,sizeof(struct node)) ;
-	list->next = newnode ;
-	newnode->key = KEY_sign ;
-	struct block_sign *sign = malloc(sizeof(struct block_sign)) ;
-	if( sign == NULL )
+	struct render_work *work = arg ;
+	for(;;)
 	{
-		fprintf(stderr,"Malloc error on data block\n") ;
-		return 1 ;
+		pthread_mutex_lock(&(work->lock)) ;
+		while( !work->failed && work->next < work->nchunks && work->next >= work->written + work->nslots )
+			pthread_cond_wait(&(work->freed),&(work->lock)) ;
+		if( work->failed || work->next >= work->nchunks )
+		{
+			pthread_mutex_unlock(&(work->lock)) ;
+			break ;
+		}
+		struct render_chunk *chunk = &(work->chunks[work->next]) ;
+		struct render_slot *slot = &(work->slots[work->next % work->nslots]) ;
+		work->next++ ;
+		pthread_mutex_unlock(&(work->lock)) ;
+		struct config config = chunk->config ;
+		int err = 0 ;
+		for( size_t count = chunk->first ; err == 0 && count < chunk->last ; count++ )
+			err = dump_block(&(work->table->nodes[count]),&config,&(slot->out)) ;
+		pthread_mutex_lock(&(work->lock)) ;
+		slot->err = err ;
+		slot->ready = 1 ;
+		pthread_cond_broadcast(&(work->rendered)) ;
+		pthread_mutex_unlock(&(work->lock)) ;
 	}
-	memset(sign,0,sizeof(struct block_sign)) ;
-	newnode->data = (unsigned char *)sign ;
-	newnode->size = sizeof(struct block_sign) ;
-	if( read_parameter(fd,"version:%4c",(void *)&(sign->version)) ) return 1 ;
-	if( read_parameter(fd,"filetype:%4c",(void *)&(sign->filetype)) ) return 1 ;
-	if( read_parameter(fd,"sitecode:%4c",(void *)&(sign->sitecode)) ) return 1 ;
-	if( read_parameter(fd,"userflags:%x",(void *)&(sign->userflags)) ) return 1 ;
-	char format[32] ;
-	sprintf(format,"description:%%%dc",SIZE_DESCRIPTION) ;
-	if( read_parameter(fd,format,(void *)(sign->description)) ) return 1 ;
-	sprintf(format,"ownername:%%%dc",SIZE_OWNERNAME) ;
-	if( read_parameter(fd,format,(void *)(sign->ownername)) ) return 1 ;
-	sprintf(format,"comment:%%%dc",SIZE_COMMENT) ;
-	if( read_parameter(fd,format,(void *)(sign->comment)) ) return 1 ;
-	return 0 ;
+	return NULL ;
 }
 
-int gen_block_sign(struct node *node, FILE *outfile)
-{
-	struct block_sign *sign = (struct block_sign *)(node->data) ;
-	endian_fixup(&(node->key),sizeof(node->key)) ;
-	if( fwrite(&(node->key),sizeof(node->key),1,outfile) != 1 ) return 1 ;
-	endian_fixup(&(node->size),sizeof(node->size)) ;
-	if( fwrite(&(node->size),sizeof(node->size),1,outfile) != 1 ) return 1 ;
-	//endian_fixup(&(sign->version),sizeof(sign->version)) ;
-	if( fwrite(&(sign->version),sizeof(sign->version),1,outfile) != 1 ) return 1 ;
-	//endian_fixup(&(sign->filetype),sizeof(sign->filetype)) ;
-	if( fwrite(&(sign->filetype),sizeof(sign->filetype),1,outfile) != 1 ) return 1 ;
-	//endian_fixup(&(sign->sitecode),sizeof(sign->sitecode)) ;
-	if( fwrite(&(sign->sitecode),sizeof(sign->sitecode),1,outfile) != 1 ) return 1 ;
-	//endian_fixup(&(sign->userflags),sizeof(sign->userflags)) ;
-	if( fwrite(&(sign->userflags),sizeof(sign->userflags),1,outfile) != 1 ) return 1 ;
-	if( fwrite(&(sign->description),SIZE_DESCRIPTION,1,outfile) != 1 ) return 1 ;
-	if( fwrite(&(sign->ownername),SIZE_OWNERNAME,1,outfile) != 1 ) return 1 ;
-	if( fwrite(&(sign->comment),SIZE_COMMENT,1,outfile) != 1 ) return 1 ;
-	return 0 ;
-}
 
+// Shortest round-trip formatting of the float I/Q samples, for dump_fields.
+// A float needs at most 9 significant digits to read back exactly, and most need fewer. format_float() writes the fewest digits that
+// strtof() turns back into the same float, found with the Ryu algorithm (Ulf Adams, PLDI 2018): the interval of decimals that round to the
+// float is scaled by a power of 10 using 64 bit multipliers for 5^q, so no big integer or libc conversion is needed.
 
-struct block_mcda
-{
-	uint32_t filetimestamp ;		// mac timestamp of first sweep
-} __attribute__((packed)) ;	// make sure there's no padding
+#define FLOAT_MANTISSA_BITS	23
+#define FLOAT_EXPONENT_BITS	8
+#define FLOAT_BIAS		127
+#define FLOAT_POW5_INV_BITCOUNT	59	// the bits in each entry of Global_pow5_inv_split
+#define FLOAT_POW5_BITCOUNT	61	// the bits in each entry of Global_pow5_split
+#define SIZE_FLOAT_TEXT		24	// room for the longest output of format_float(), "-1.17549435e-38" or a NaN payload
+#define SIZE_IQ_LINE		(24 + 2*(SIZE_FLOAT_TEXT + 2))	// room for a line written by format_iq_line()
+#define SIZE_HEX_TEXT		32	// room for the longest output of format_hex(), "-0x1.fffffffffffffp+1023"
+#define DOUBLE_MANTISSA_BITS	52
+#define DOUBLE_EXPONENT_BITS	11
 
-int fixup_data_mcda(struct node *node)
+const uint64_t Global_pow5_inv_split[31] =	// 2^(ceil(log2(5^q)) - 1 + 59) / 5^q, rounded up, for q from 0 to 30
 {
-	if( node->size < sizeof(struct block_mcda) )
-	{
-		fprintf(stderr,"Block '%s' is truncated\n",strkey(KEY_mcda)) ;
-		return 1 ;
-	}
-	struct block_mcda *mcda = (struct block_mcda *)(node->data) ;
-	endian_fixup(&(mcda->filetimestamp),sizeof(mcda->filetimestamp)) ;
-	return 0 ;
-}
+	576460752303423489u, 461168601842738791u, 368934881474191033u, 295147905179352826u,
+	472236648286964522u, 377789318629571618u, 302231454903657294u, 483570327845851670u,
+	386856262276681336u, 309485009821345069u, 495176015714152110u, 396140812571321688u,
+	316912650057057351u, 507060240091291761u, 405648192073033409u, 324518553658426727u,
+	519229685853482763u, 415383748682786211u, 332306998946228969u, 531691198313966350u,
+	425352958651173080u, 340282366920938464u, 544451787073501542u, 435561429658801234u,
+	348449143727040987u, 557518629963265579u, 446014903970612463u, 356811923176489971u,
+	570899077082383953u, 456719261665907162u, 365375409332725730u
+} ;
 
-int dump_block_mcda(struct node *node, struct config *config, FILE *outfile)
+const uint64_t Global_pow5_split[47] =		// 5^i scaled to 61 bits, for i from 0 to 46
 {
-	if( node->size < sizeof(struct block_mcda) )
-	{
-		fprintf(stderr,"Block '%s' is truncated\n",strkey(KEY_mcda)) ;
-		return 1 ;
-	}
-	struct block_mcda *mcda = (struct block_mcda *)(node->data) ;
-	uint32_t mcda_time = mcda->filetimestamp ;
-	time_t t = mcda_time ;
-	fprintf(outfile,"%s\n",strkey(KEY_mcda)) ;
-	if( t != 0 )
-	{
-		t -= 2082844800 ;	// move epoc from 1904-01-01 00:00:00 to 1970-01-01 00:00:00 
-		fprintf(outfile,"filetimestamp:%lu (NB: seconds since 1970) (%.24s)\n",t,ctime(&t)) ;
-	}
-	fprintf(outfile,"\n") ;
-	return 0 ;
-}
+	1152921504606846976u, 1441151880758558720u, 1801439850948198400u, 2251799813685248000u,
+	1407374883553280000u, 1759218604441600000u, 2199023255552000000u, 1374389534720000000u,
+	1717986918400000000u, 2147483648000000000u, 1342177280000000000u, 1677721600000000000u,
+	2097152000000000000u, 1310720000000000000u, 1638400000000000000u, 2048000000000000000u,
+	1280000000000000000u, 1600000000000000000u, 2000000000000000000u, 1250000000000000000u,
+	1562500000000000000u, 1953125000000000000u, 1220703125000000000u, 1525878906250000000u,
+	1907348632812500000u, 1192092895507812500u, 1490116119384765625u, 1862645149230957031u,
+	1164153218269348144u, 1455191522836685180u, 1818989403545856475u, 2273736754432320594u,
+	1421085471520200371u, 1776356839400250464u, 2220446049250313080u, 1387778780781445675u,
+	1734723475976807094u, 2168404344971008868u, 1355252715606880542u, 1694065894508600678u,
+	2117582368135750847u, 1323488980084844279u, 1654361225106055349u, 2067951531382569187u,
+	1292469707114105741u, 1615587133892632177u, 2019483917365790221u
+} ;
 
-int make_node_mcda(struct node *list, struct config *config, FILE *fd)		// creates a new node for mcda block
+static inline int32_t pow5_bits(int32_t e)	// returns ceil(log2(5^e)), or 1 for e == 0, exact for e from 0 to 3528
 {
-	struct node *newnode = malloc(sizeof(struct node)) ;
-	if( newnode == NULL )
-	{
-		fprintf(stderr,"Malloc error on list node\n") ;
-		return 1 ;
-	}
-	memset(newnode,0,sizeof(struct node)) ;
-	list->next = newnode ;
-	newnode->key = KEY_mcda ;
-	struct block_mcda *mcda = malloc(sizeof(struct block_mcda)) ;
-	if( mcda == NULL )
-	{
-		fprintf(stderr,"Malloc error on data block\n") ;
-		return 1 ;
-	}
-	memset(mcda,0,sizeof(struct block_mcda)) ;
-	newnode->data = (unsigned char *)mcda ;
-	newnode->size = sizeof(struct block_mcda) ;
-	if( read_parameter(fd,"filetimestamp:%u",(void *)&(mcda->filetimestamp)) ) return 1 ;
-	mcda->filetimestamp += 2082844800 ;	// move epoc from 1970-01-01 00:00:00 to 1904-01-01 00:00:00 
-	return 0 ;
+	return (int32_t )(((uint32_t )e * 1217359) >> 19) + 1 ;
 }
 
-int gen_block_mcda(struct node *node, FILE *outfile)
+static inline uint32_t log10_pow2(int32_t e)	// returns floor(log10(2^e)), exact for e from 0 to 1650
 {
-	struct block_mcda *mcda = (struct block_mcda *)(node->data) ;
-	endian_fixup(&(node->key),sizeof(node->key)) ;
-	if( fwrite(&(node->key),sizeof(node->key),1,outfile) != 1 ) return 1 ;
-	endian_fixup(&(node->size),sizeof(node->size)) ;
-	if( fwrite(&(node->size),sizeof(node->size),1,outfile) != 1 ) return 1 ;
-	endian_fixup(&(mcda->filetimestamp),sizeof(mcda->filetimestamp)) ;
-	if( fwrite(&(mcda->filetimestamp),sizeof(mcda->filetimestamp),1,outfile) != 1 ) return 1 ;
-	return 0 ;
+	return ((uint32_t )e * 78913) >> 18 ;
 }
 
-
-struct block_dbrf
+static inline uint32_t log10_pow5(int32_t e)	// returns floor(log10(5^e)), exact for e from 0 to 2620
 {
-	double rxloss ;		// received power correction, in dB
-} __attribute__((packed)) ;	// make sure there's no padding
+	return ((uint32_t )e * 732923) >> 20 ;
+}
 
-int fixup_data_dbrf(struct node *node)
+static inline int multiple_of_pow5(uint32_t value, uint32_t p)	// returns 1 if 5^p divides value
 {
-	if( node->size < sizeof(struct block_dbrf) )
+	uint32_t count = 0 ;
+	while( value != 0 && value % 5 == 0 )
 	{
-		fprintf(stderr,"Block '%s' is truncated\n",strkey(KEY_dbrf)) ;
-		return 1 ;
+		value /= 5 ;
+		count++ ;
 	}
-	struct block_dbrf *dbrf = (struct block_dbrf *)(node->data) ;
-	endian_fixup(&(dbrf->rxloss),sizeof(dbrf->rxloss)) ;
-	return 0 ;
+	return count >= p ;
 }
 
-int dump_block_dbrf(struct node *node, struct config *config, FILE *outfile)
+static inline uint32_t mul_shift_32(uint32_t m, uint64_t factor, int32_t shift)	// returns (m * factor) >> shift, for a shift of more than 32
 {
-	if( node->size < sizeof(struct block_dbrf) )
-	{
-		fprintf(stderr,"Block '%s' is truncated\n",strkey(KEY_dbrf)) ;
-		return 1 ;
-	}
-	struct block_dbrf *dbrf = (struct block_dbrf *)(node->data) ;
-	fprintf(outfile,"%s\n",strkey(KEY_dbrf)) ;
-	fprintf(outfile,"rxloss:%.4lf\n",dbrf->rxloss) ;
-	fprintf(outfile,"\n") ;
-	return 0 ;
+	uint64_t bits0 = (uint64_t )m * (uint32_t )factor ;
+	uint64_t bits1 = (uint64_t )m * (uint32_t )(factor >> 32) ;
+	uint64_t sum = (bits0 >> 32) + bits1 ;
+	return (uint32_t )(sum >> (shift - 32)) ;
 }
 
-int make_node_dbrf(struct node *list, struct config *config, FILE *fd)		// creates a new node for dbrf block
+void shortest_float(uint32_t ieee_mantissa, uint32_t ieee_exponent, uint32_t *digits, int32_t *exponent)	// finds the shortest digits * 10^exponent that rounds to the finite, nonzero float with these bits
 {
-	struct node *newnode = malloc(sizeof(struct node)) ;
-	if( newnode == NULL )
+	int32_t e2 ;
+	uint32_t m2 ;
+	if( ieee_exponent == 0 )	// subnormal
 	{
-		fprintf(stderr,"Malloc error on list node\n") ;
-		return 1 ;
+		e2 = 1 - FLOAT_BIAS - FLOAT_MANTISSA_BITS - 2 ;
+		m2 = ieee_mantissa ;
 	}
-	memset(newnode,0,sizeof(struct node)) ;
-	list->next = newnode ;
-	newnode->key = KEY_dbrf ;
-	struct block_dbrf *dbrf = malloc(sizeof(struct block_dbrf)) ;
-	if( dbrf == NULL )
+	else
 	{
-		fprintf(stderr,"Malloc error on data block\n") ;
-		return 1 ;
+		e2 = (int32_t )ieee_exponent - FLOAT_BIAS - FLOAT_MANTISSA_BITS - 2 ;
+		m2 = (1u << FLOAT_MANTISSA_BITS) | ieee_mantissa ;
 	}
-	memset(dbrf,0,sizeof(struct block_dbrf)) ;
-	newnode->data = (unsigned char *)dbrf ;
-	newnode->size = sizeof(struct block_dbrf) ;
-	if( read_parameter(fd,"rxloss:%lf",(void *)&(dbrf->rxloss)) ) return 1 ;
-	return 0 ;
-}
-
-int gen_block_dbrf(struct node *node, FILE *outfile)
-{
-	struct block_dbrf *dbrf = (struct block_dbrf *)(node->data) ;
-	endian_fixup(&(node->key),sizeof(node->key)) ;
-	if( fwrite(&(node->key),sizeof(node->key),1,outfile) != 1 ) return 1 ;
-	endian_fixup(&(node->size),sizeof(node->size)) ;
-	if( fwrite(&(node->size),sizeof(node->size),1,outfile) != 1 ) return 1 ;
-	endian_fixup(&(dbrf->rxloss),sizeof(dbrf->rxloss)) ;
-	if( fwrite(&(dbrf->rxloss),sizeof(dbrf->rxloss),1,outfile) != 1 ) return 1 ;
-	return 0 ;
-}
-
-
-struct block_cnst
-{
-	int32_t nchannels ;		// number of antennas/channels (normally 3)
-	int32_t nranges ;		// number of ranges
-	int32_t nsweeps ;		// number of sweeps (normally 32)
-	int32_t iqindicator ;		// iqindicator: 1=?, 2=IQ
-} __attribute__((packed)) ;	// make sure there's no padding
-
-int fixup_data_cnst(struct node *node)
-{
-	if( node->size < sizeof(struct block_cnst) )
+	int accept_bounds = (m2 & 1) == 0 ;	// round half to even, so an even float owns the midpoints at both ends of its interval
+	// the float is mv * 2^e2, and the decimals between mm and mp (times 2^e2) all round to it
+	uint32_t mv = 4 * m2 ;
+	uint32_t mp = 4 * m2 + 2 ;
+	uint32_t mm_shift = ieee_mantissa != 0 || ieee_exponent <= 1 ;	// the gap below a power of 2 is half the size
+	uint32_t mm = 4 * m2 - 1 - mm_shift ;
+	// scale the interval by 10^-e10 to integers vr, vp and vm, noting whether any digits dropped by the scaling were all zero
+	uint32_t vr, vp, vm ;
+	int32_t e10 ;
+	int vm_trailing_zeros = 0 ;
+	int vr_trailing_zeros = 0 ;
+	uint32_t last_removed_digit = 0 ;
+	if( e2 >= 0 )
+	{
+		uint32_t q = log10_pow2(e2) ;
+		e10 = (int32_t )q ;
+		int32_t k = FLOAT_POW5_INV_BITCOUNT + pow5_bits((int32_t )q) - 1 ;
+		int32_t i = -e2 + (int32_t )q + k ;
+		vr = mul_shift_32(mv,Global_pow5_inv_split[q],i) ;
+		vp = mul_shift_32(mp,Global_pow5_inv_split[q],i) ;
+		vm = mul_shift_32(mm,Global_pow5_inv_split[q],i) ;
+		if( q != 0 && (vp - 1)/10 <= vm/10 )	// the loop below removes no digits, but rounding needs the last one scaled away
+		{
+			int32_t l = FLOAT_POW5_INV_BITCOUNT + pow5_bits((int32_t )(q - 1)) - 1 ;
+			last_removed_digit = mul_shift_32(mv,Global_pow5_inv_split[q-1],-e2 + (int32_t )q - 1 + l) % 10 ;
+		}
+		if( q <= 9 )	// only one of mp, mv and mm can be a multiple of 5
+		{
+			if( mv % 5 == 0 )
+				vr_trailing_zeros = multiple_of_pow5(mv,q) ;
+			else if( accept_bounds )
+				vm_trailing_zeros = multiple_of_pow5(mm,q) ;
+			else
+				vp -= multiple_of_pow5(mp,q) ;
+		}
+	}
+	else
+	{
+		uint32_t q = log10_pow5(-e2) ;
+		e10 = (int32_t )q + e2 ;
+		int32_t i = -e2 - (int32_t )q ;
+		int32_t k = pow5_bits(i) - FLOAT_POW5_BITCOUNT ;
+		int32_t j = (int32_t )q - k ;
+		vr = mul_shift_32(mv,Global_pow5_split[i],j) ;
+		vp = mul_shift_32(mp,Global_pow5_split[i],j) ;
+		vm = mul_shift_32(mm,Global_pow5_split[i],j) ;
+		if( q != 0 && (vp - 1)/10 <= vm/10 )
+		{
+			j = (int32_t )q - 1 - (pow5_bits(i + 1) - FLOAT_POW5_BITCOUNT) ;
+			last_removed_digit = mul_shift_32(mv,Global_pow5_split[i+1],j) % 10 ;
+		}
+		if( q <= 1 )	// mv = 4 * m2 has at least 2 trailing zero bits, mp at least 1, and mm has 1 only if mm_shift is 1
+		{
+			vr_trailing_zeros = 1 ;
+			if( accept_bounds )
+				vm_trailing_zeros = mm_shift == 1 ;
+			else
+				vp-- ;
+		}
+		else if( q < 31 )
+		{
+			vr_trailing_zeros = (mv & ((1u << (q - 1)) - 1)) == 0 ;
+		}
+	}
+	// remove digits while the interval still holds a shorter decimal
+	int32_t removed = 0 ;
+	uint32_t output ;
+	if( vm_trailing_zeros || vr_trailing_zeros )	// the rare general case, where an exact tie or an end of the interval matters
+	{
+		while( vp/10 > vm/10 )
+		{
+			vm_trailing_zeros &= vm % 10 == 0 ;
+			vr_trailing_zeros &= last_removed_digit == 0 ;
+			last_removed_digit = vr % 10 ;
+			vr /= 10 ;
+			vp /= 10 ;
+			vm /= 10 ;
+			removed++ ;
+		}
+		if( vm_trailing_zeros )
+		{
+			while( vm % 10 == 0 )
+			{
+				vr_trailing_zeros &= last_removed_digit == 0 ;
+				last_removed_digit = vr % 10 ;
+				vr /= 10 ;
+				vp /= 10 ;
+				vm /= 10 ;
+				removed++ ;
+			}
+		}
+		if( vr_trailing_zeros && last_removed_digit == 5 && vr % 2 == 0 )
+			last_removed_digit = 4 ;	// the exact value is ...50000, round to even
+		output = vr + ((vr == vm && (!accept_bounds || !vm_trailing_zeros)) || last_removed_digit >= 5) ;
+	}
+	else
 	{
-		fprintf(stderr,"Block '%s' is truncated\n",strkey(KEY_cnst)) ;
-		return 1 ;
+		while( vp/10 > vm/10 )
+		{
+			last_removed_digit = vr % 10 ;
+			vr /= 10 ;
+			vp /= 10 ;
+			vm /= 10 ;
+			removed++ ;
+		}
+		output = vr + (vr == vm || last_removed_digit >= 5) ;
 	}
-	struct block_cnst *cnst = (struct block_cnst *)node->data ;
-	endian_fixup(&(cnst->nchannels),sizeof(cnst->nchannels)) ;
-	endian_fixup(&(cnst->nranges),sizeof(cnst->nranges)) ;
-	endian_fixup(&(cnst->nsweeps),sizeof(cnst->nchannels)) ;
-	endian_fixup(&(cnst->iqindicator),sizeof(cnst->iqindicator)) ;
-	return 0 ;
+	*digits = output ;
+	*exponent = e10 + removed ;
 }
 
-int dump_block_cnst(struct node *node, struct config *config, FILE *outfile)
+int format_float(float value, char *text)	// writes the shortest text that strtof() reads back as exactly value, with a terminating 0, returns its length
+// the text is plain decimal if the first digit is within 10^-4 to 10^8, like %g, otherwise it has an exponent, as in 1.5e-07
 {
-	if( node->size < sizeof(struct block_cnst) )
+	uint32_t bits ;
+	memcpy(&bits,&value,sizeof(bits)) ;
+	uint32_t ieee_mantissa = bits & ((1u << FLOAT_MANTISSA_BITS) - 1) ;
+	uint32_t ieee_exponent = (bits >> FLOAT_MANTISSA_BITS) & ((1u << FLOAT_EXPONENT_BITS) - 1) ;
+	char *p = text ;
+	if( bits >> 31 )
+		*p++ = '-' ;
+	if( ieee_exponent == (1u << FLOAT_EXPONENT_BITS) - 1 )
 	{
-		fprintf(stderr,"Block '%s' is truncated\n",strkey(KEY_cnst)) ;
-		return 1 ;
+		if( ieee_mantissa == 0 )
+			return (int )(p - text) + sprintf(p,"inf") ;
+		return (int )(p - text) + sprintf(p,"nan(0x%x)",ieee_mantissa) ;	// strtof() puts the payload back
 	}
-	struct block_cnst *cnst = (struct block_cnst *)(node->data) ;
-	fprintf(outfile,"%s\n",strkey(KEY_cnst)) ;
-	fprintf(outfile,"nchannels:%d\n",cnst->nchannels) ;
-	fprintf(outfile,"nranges:%d\n",cnst->nranges) ;
-	fprintf(outfile,"nsweeps:%d\n",cnst->nsweeps) ;
-	fprintf(outfile,"iqindicator:%d\n",cnst->iqindicator) ;
-	fprintf(outfile,"\n") ;
-	return 0 ;
-}
-
-int make_node_cnst(struct node *list, struct config *config, FILE *fd)		// creates a new node for cnst block
-{
-	struct node *newnode = malloc(sizeof(struct node)) ;
-	if( newnode == NULL )
+	if( ieee_exponent == 0 && ieee_mantissa == 0 )
 	{
-		fprintf(stderr,"Malloc error on list node\n") ;
-		return 1 ;
+		*p++ = '0' ;
+		*p = '\0' ;
+		return (int )(p - text) ;
 	}
-	memset(newnode,0,sizeof(struct node)) ;
-	list->next = newnode ;
-	newnode->key = KEY_cnst ;
-	struct block_cnst *cnst = malloc(sizeof(struct block_cnst)) ;
-	if( cnst == NULL )
+	uint32_t digits ;
+	int32_t exponent ;
+	shortest_float(ieee_mantissa,ieee_exponent,&digits,&exponent) ;
+	while( digits % 10 == 0 )	// a rounding carry can leave a trailing zero
 	{
-		fprintf(stderr,"Malloc error on data block\n") ;
-		return 1 ;
+		digits /= 10 ;
+		exponent++ ;
 	}
-	memset(cnst,0,sizeof(struct block_cnst)) ;
-	newnode->data = (unsigned char *)cnst ;
-	newnode->size = sizeof(struct block_cnst) ;
-	if( read_parameter(fd,"nchannels:%d",(void *)&(cnst->nchannels)) ) return 1 ;
-	if( read_parameter(fd,"nranges:%d",(void *)&(cnst->nranges)) ) return 1 ;
-	if( read_parameter(fd,"nsweeps:%d",(void *)&(cnst->nsweeps)) ) return 1 ;
-	if( read_parameter(fd,"iqindicator:%d",(void *)&(cnst->iqindicator)) ) return 1 ;
-	return 0 ;
+	char buffer[10] ;	// the digits, at most 9
+	int ndigits = 0 ;
+	for( uint32_t d = digits ; d != 0 ; d /= 10 )
+		buffer[ndigits++] = '0' + d % 10 ;	// least significant first
+	int32_t point = ndigits + exponent ;	// the number of digits before the decimal point
+	if( point > 9 || point < -3 )	// d.ddde+XX
+	{
+		*p++ = buffer[ndigits-1] ;
+		if( ndigits > 1 )
+		{
+			*p++ = '.' ;
+			for( int i = ndigits - 2 ; i >= 0 ; i-- )
+				*p++ = buffer[i] ;
+		}
+		int32_t e = point - 1 ;
+		*p++ = 'e' ;
+		*p++ = e < 0 ? '-' : '+' ;
+		if( e < 0 )
+			e = -e ;
+		if( e >= 10 )
+			*p++ = '0' + e/10 ;
+		else
+			*p++ = '0' ;
+		*p++ = '0' + e % 10 ;
+	}
+	else if( point <= 0 )	// 0.000ddd
+	{
+		*p++ = '0' ;
+		*p++ = '.' ;
+		for( int32_t i = point ; i < 0 ; i++ )
+			*p++ = '0' ;
+		for( int i = ndigits - 1 ; i >= 0 ; i-- )
+			*p++ = buffer[i] ;
+	}
+	else if( point >= ndigits )	// ddd000, an integer
+	{
+		for( int i = ndigits - 1 ; i >= 0 ; i-- )
+			*p++ = buffer[i] ;
+		for( int32_t i = ndigits ; i < point ; i++ )
+			*p++ = '0' ;
+	}
+	else	// ddd.ddd
+	{
+		for( int i = ndigits - 1 ; i >= 0 ; i-- )
+		{
+			*p++ = buffer[i] ;
+			if( i == ndigits - point )
+				*p++ = '.' ;
+		}
+	}
+	*p = '\0' ;
+	return (int )(p - text) ;
 }
 
-int gen_block_cnst(struct node *node, FILE *outfile)
+int format_iq_line(size_t index, float isample, float qsample, int hex, char *line)	// writes the text line for an I/Q sample into line, which has room for SIZE_IQ_LINE, returns its length
+// the line is laid out as "%3zu % g % g\n" would be, a space in place of the sign for positive values, but each value has the shortest digits
+// or, if hex is set, is a hex float as "% a" would write it
 {
-	struct block_cnst *cnst = (struct block_cnst *)(node->data) ;
-	endian_fixup(&(node->key),sizeof(node->key)) ;
-	if( fwrite(&(node->key),sizeof(node->key),1,outfile) != 1 ) return 1 ;
-	endian_fixup(&(node->size),sizeof(node->size)) ;
-	if( fwrite(&(node->size),sizeof(node->size),1,outfile) != 1 ) return 1 ;
-	endian_fixup(&(cnst->nchannels),sizeof(cnst->nchannels)) ;
-	if( fwrite(&(cnst->nchannels),sizeof(cnst->nchannels),1,outfile) != 1 ) return 1 ;
-	endian_fixup(&(cnst->nranges),sizeof(cnst->nranges)) ;
-	if( fwrite(&(cnst->nranges),sizeof(cnst->nranges),1,outfile) != 1 ) return 1 ;
-	endian_fixup(&(cnst->nsweeps),sizeof(cnst->nsweeps)) ;
-	if( fwrite(&(cnst->nsweeps),sizeof(cnst->nsweeps),1,outfile) != 1 ) return 1 ;
-	endian_fixup(&(cnst->iqindicator),sizeof(cnst->iqindicator)) ;
-	if( fwrite(&(cnst->iqindicator),sizeof(cnst->iqindicator),1,outfile) != 1 ) return 1 ;
-	return 0 ;
+	char digits[24] ;
+	int ndigits = 0 ;
+	do
+	{
+		digits[ndigits++] = '0' + index % 10 ;
+		index /= 10 ;
+	} while( index != 0 ) ;
+	char *p = line ;
+	for( int pad = ndigits ; pad < 3 ; pad++ )
+		*p++ = ' ' ;
+	while( ndigits > 0 )
+		*p++ = digits[--ndigits] ;
+	*p++ = ' ' ;
+	if( !signbit(isample) )
+		*p++ = ' ' ;
+	p += hex ? format_hex_float(isample,p) : format_float(isample,p) ;
+	*p++ = ' ' ;
+	if( !signbit(qsample) )
+		*p++ = ' ' ;
+	p += hex ? format_hex_float(qsample,p) : format_float(qsample,p) ;
+	*p++ = '\n' ;
+	return (int )(p - line) ;
 }
 
-
-struct block_hasi
-{
-	uint32_t hasi ;		// hasi (?)
-} __attribute__((packed)) ;	// make sure there's no padding
-
-int fixup_data_hasi(struct node *node)
+int parse_float(char *text, char **end, float *value)	// reads a float written by format_float() or format_hex_float(), or any text that strtof() takes, returns 1 if there is none
 {
-	if( node->size < sizeof(struct block_hasi) )
+	double exact ;
+	if( parse_hex_float(text,end,&exact) == 0 )	// rounds only once, the double holds the hex digits exactly
 	{
-		fprintf(stderr,"Block '%s' is truncated\n",strkey(KEY_hasi)) ;
+		*value = (float )exact ;
+		return 0 ;
+	}
+	float number = strtof(text,end) ;	// directly to float, with one rounding, never through a double
+	if( *end == text )
 		return 1 ;
+	if( isnan(number) )	// strtof() quiets a signalling NaN, so put back the whole payload written by format_float()
+	{
+		char *payload = memchr(text,'(',*end - text) ;
+		uint32_t bits ;
+		memcpy(&bits,&number,sizeof(bits)) ;
+		uint32_t mantissa = payload != NULL ? strtoul(payload+1,NULL,16) & ((1u << FLOAT_MANTISSA_BITS) - 1) : 0 ;
+		if( mantissa != 0 )
+			bits = (bits & ~((1u << FLOAT_MANTISSA_BITS) - 1)) | mantissa ;
+		memcpy(&number,&bits,sizeof(bits)) ;
 	}
-	//struct block_hasi *hasi = (struct block_hasi *)node->data ;
-	//endian_fixup(&(hasi->hasi),sizeof(hasi->hasi)) ;
+	*value = number ;
 	return 0 ;
 }
 
-int dump_block_hasi(struct node *node, struct config *config, FILE *outfile)
+int format_hex(uint64_t bits, int mantissa_bits, int exponent_bits, char *text)	// writes a finite float or double, given its bits, as a C99 hex float with a terminating 0, returns its length
+// the text is what printf("%a") writes for a normal double, "-0x1.8p+3", with the trailing zero digits dropped; subnormals are normalized
+// each hex digit is 4 bits of the mantissa, so there is no rounding at all and strtod() or parse_hex_float() read back exactly the same value
 {
-	if( node->size < sizeof(struct block_hasi) )
+	char *p = text ;
+	uint64_t mask = (UINT64_C(1) << mantissa_bits) - 1 ;
+	uint64_t mantissa = bits & mask ;
+	int biased = (bits >> mantissa_bits) & ((1 << exponent_bits) - 1) ;
+	int exponent = biased - ((1 << (exponent_bits - 1)) - 1) ;
+	if( (bits >> (mantissa_bits + exponent_bits)) & 1 )
+		*p++ = '-' ;
+	*p++ = '0' ;
+	*p++ = 'x' ;
+	if( biased == 0 )
 	{
-		fprintf(stderr,"Block '%s' is truncated\n",strkey(KEY_hasi)) ;
-		return 1 ;
+		if( mantissa == 0 )
+		{
+			memcpy(p,"0p+0",5) ;
+			return (int )(p - text) + 4 ;
+		}
+		int shift = __builtin_clzll(mantissa) - (63 - mantissa_bits) ;	// move the leading 1 to the implicit bit
+		mantissa = (mantissa << shift) & mask ;
+		exponent += 1 - shift ;
 	}
-	fprintf(outfile,"%s\n",strkey(KEY_hasi)) ;
-	// unknown structure, dump the raw data bytes
-	hexdump(node->data,node->size,outfile) ;
-	fprintf(outfile,"\n") ;
-	return 0 ;
+	*p++ = '1' ;
+	int fraction_bits = (mantissa_bits + 3) & ~3 ;		// a whole number of hex digits
+	mantissa <<= fraction_bits - mantissa_bits ;
+	if( mantissa != 0 )
+	{
+		*p++ = '.' ;
+		for( int shift = fraction_bits - 4 ; mantissa != 0 ; shift -= 4 )
+		{
+			*p++ = "0123456789abcdef"[(mantissa >> shift) & 0xf] ;
+			mantissa &= (UINT64_C(1) << shift) - 1 ;
+		}
+	}
+	*p++ = 'p' ;
+	*p++ = exponent < 0 ? '-' : '+' ;
+	unsigned int magnitude = exponent < 0 ? -exponent : exponent ;
+	char digits[8] ;
+	int ndigits = 0 ;
+	do
+	{
+		digits[ndigits++] = '0' + magnitude % 10 ;
+		magnitude /= 10 ;
+	} while( magnitude != 0 ) ;
+	while( ndigits > 0 )
+		*p++ = digits[--ndigits] ;
+	*p = '\0' ;
+	return (int )(p - text) ;
 }
 
-void hexdump(unsigned char *data, unsigned int size, FILE *outfile)
+int format_hex_float(float value, char *text)	// writes value as a C99 hex float into text, which has room for SIZE_FLOAT_TEXT, returns its length
 {
-	int loop ;
-	fprintf(outfile,"data:") ;
-	for( loop = 0 ; loop < size ; loop++, data++ )
-	{
-		fprintf(outfile," %02x",data[0]) ;
-	}
-	fprintf(outfile,"\n") ;
+	if( !isfinite(value) )		// infinities and NaN payloads are written as in decimal mode
+		return format_float(value,text) ;
+	uint32_t bits ;
+	memcpy(&bits,&value,sizeof(bits)) ;
+	return format_hex(bits,FLOAT_MANTISSA_BITS,FLOAT_EXPONENT_BITS,text) ;
 }
 
-#define MAX_ARGC 256
-#define MAX_LINE MAX_ARGC*3+1
+int format_hex_double(double value, char *text)	// writes value as a C99 hex float into text, which has room for SIZE_HEX_TEXT, returns its length
+{
+	if( !isfinite(value) )
+		return snprintf(text,SIZE_HEX_TEXT,"%a",value) ;
+	uint64_t bits ;
+	memcpy(&bits,&value,sizeof(bits)) ;
+	return format_hex(bits,DOUBLE_MANTISSA_BITS,DOUBLE_EXPONENT_BITS,text) ;
+}
 
-int make_node_hasi(struct node *list, struct config *config, FILE *fd)		// creates a new node for hasi block
+int parse_hex_float(const char *text, char **end, double *value)	// reads a hex float such as format_hex() writes, returns 1 without setting end if text isn't one that fits a double exactly
+// this is the fast path of parse_float(), anything else, such as decimal text, a NaN or more than 53 significant bits, is left for strtof() or strtod()
 {
-	struct node *newnode = malloc(sizeof(struct node)) ;
-	if( newnode == NULL )
-	{
-		fprintf(stderr,"Malloc error on list node\n") ;
+	const char *p = text ;
+	while( *p == ' ' || *p == '\t' )
+		p++ ;
+	int negative = *p == '-' ;
+	if( *p == '-' || *p == '+' )
+		p++ ;
+	if( p[0] != '0' || (p[1] != 'x' && p[1] != 'X') )
 		return 1 ;
-	}
-	memset(newnode,0,sizeof(struct node)) ;
-	list->next = newnode ;
-	newnode->key = KEY_hasi ;
-	// read a line of unformatted data
-	char line[MAX_LINE] ;
-	if( fgets(line,MAX_LINE-1,fd) == 0 )
-	{
-		if( Debug ) { fprintf(stderr,"debug: make_node_hasi: fgets returned 0\n") ; }
-		return -1 ;
-	}
-	line[MAX_LINE-1] = '\0' ;
-	chomp(line,MAX_LINE) ;
-	// split the line into space-separated args, storing the argv
-	char sep[] = " " ;
-	char *argv[MAX_ARGC] ;
-	int argc = 0 ;
-	argv[0] = strtok(line,sep) ;	// the first arg is "data:"
-	argv[0] = strtok(NULL,sep) ;	// get the first data byte
-	while( argv[argc] && argc < MAX_ARGC )
-	{
-		argv[++argc] = strtok(NULL,sep) ;
-	}
-	if( argc <= 0 )
+	p += 2 ;
+	uint64_t mantissa = 0 ;
+	long exponent = 0 ;
+	int ndigits = 0 ;
+	int point = 0 ;
+	for( ;; p++ )
 	{
-		if( Debug ) { fprintf(stderr,"debug: make_node_hasi: argc <= 0\n") ; }
-		return 1 ;
+		int digit ;
+		if( *p >= '0' && *p <= '9' )
+			digit = *p - '0' ;
+		else if( *p >= 'a' && *p <= 'f' )
+			digit = *p - 'a' + 10 ;
+		else if( *p >= 'A' && *p <= 'F' )
+			digit = *p - 'A' + 10 ;
+		else if( *p == '.' && !point )
+		{
+			point = 1 ;
+			continue ;
+		}
+		else
+			break ;
+		ndigits++ ;
+		if( mantissa >> 60 )	// no room for another digit, which must be a zero
+		{
+			if( digit != 0 )
+				return 1 ;
+			if( !point )
+				exponent += 4 ;
+			continue ;
+		}
+		mantissa = (mantissa << 4) | digit ;
+		if( point )
+			exponent -= 4 ;
 	}
-	if( argc == MAX_ARGC ) return 1 ;
-	if( Debug ) { fprintf(stderr,"debug: make_node_hasi: counted %d bytes of data\n",argc) ; }
-	// use the arg count to malloc space for the data
-	unsigned char *hasi = malloc(argc) ;
-	if( hasi == NULL )
-	{
-		fprintf(stderr,"Malloc error on data block\n") ;
+	if( ndigits == 0 )
 		return 1 ;
-	}
-	memset(hasi,0,argc) ;
-	newnode->data = hasi ;
-	newnode->size = argc ;
-	// TODO: read a line of ascii hex
-	for( int i = 0 ; i < argc ; i++ )
+	if( *p == 'p' || *p == 'P' )
 	{
-		unsigned char c = (unsigned char )strtoul(argv[i],NULL,16) ;
-		hasi[i] = c ;
-		if( Debug ) { fprintf(stderr,"debug: make_node_hasi: data[%d]=%02x\n",i,c) ; }
+		const char *q = p + 1 ;
+		int negative_exponent = *q == '-' ;
+		if( *q == '-' || *q == '+' )
+			q++ ;
+		if( *q >= '0' && *q <= '9' )
+		{
+			long power = 0 ;
+			for( ; *q >= '0' && *q <= '9' ; q++ )
+			{
+				if( power < 100000 )	// far beyond the range of a double either way
+					power = power*10 + (*q - '0') ;
+			}
+			exponent += negative_exponent ? -power : power ;
+			p = q ;
+		}
 	}
+	if( mantissa >> 53 && (mantissa & ((UINT64_C(1) << (11 - __builtin_clzll(mantissa))) - 1)) != 0 )
+		return 1 ;		// more than the 53 significant bits of a double
+	double number = ldexp((double )mantissa,(int )exponent) ;	// exact, unless the result is outside the range of a double
+	*value = negative ? -number : number ;
+	*end = (char *)p ;
 	return 0 ;
 }
 
-int gen_block_hasi(struct node *node, FILE *outfile)
+
+// The output buffer for the text dump.
+// A dump is mostly short lines, so rather than a stdio call for each field the text is formatted straight into a large buffer,
+// which goes out with one write() each time it fills. Text already in the stdio stream is flushed first so the order is kept.
+
+int out_open(struct output *out, FILE *file, int hex)	// starts an empty buffer for text going to file, or kept in memory if file is NULL, returns 1 on an error
 {
-	endian_fixup(&(node->key),sizeof(node->key)) ;
-	if( fwrite(&(node->key),sizeof(node->key),1,outfile) != 1 ) return 1 ;
-	unsigned int actualsize = node->size ;
-	if( Debug ) { fprintf(stderr,"debug: gen_block_hasi: actualsize=%u\n",actualsize) ; }
-	endian_fixup(&(node->size),sizeof(node->size)) ;
-	if( fwrite(&(node->size),sizeof(node->size),1,outfile) != 1 ) return 1 ;
-	if( fwrite(node->data,1,actualsize,outfile) != actualsize )	// no data structure, just write size bytes
+	memset(out,0,sizeof(struct output)) ;
+	out->file = file ;
+	out->hex = hex ;
+	out->data = malloc(SIZE_OUTPUT_BUFFER) ;
+	if( out->data == NULL )
 	{
-		if( Debug ) { fprintf(stderr,"debug: gen_block_hasi: error on fwrite for node->data\n") ; }
+		fprintf(stderr,"Cannot get memory for the output buffer\n") ;
+		out->err = 1 ;
 		return 1 ;
 	}
+	out->size = SIZE_OUTPUT_BUFFER ;
 	return 0 ;
 }
 
-
-struct block_swep
+int out_close(struct output *out)	// writes what is left in the buffer and frees it, returns 1 if any of the output was lost
 {
-	int32_t samplespersweep ;	// number of samples per sweep/channels (normally 2048)
-	double sweepstart ;		// sweep start frequency in Hertz
-	double sweepbandwidth ;		// sweep bandwidth in Hertz
-	double sweeprate ;		// sweep rate in Hertz
-	int32_t rangeoffset ;		// rangeoffset (not used)
-} __attribute__((packed)) ;	// make sure there's no padding
+	int err = out_flush(out) ;
+	free(out->data) ;
+	out->data = NULL ;
+	out->size = 0 ;
+	return err ;
+}
 
-int fixup_data_swep(struct node *node)
+int out_flush(struct output *out)	// writes the text in the buffer to the file, returns 1 if any of the output was lost
 {
-	if( node->size < sizeof(struct block_swep) )
+	if( out->file == NULL || out->err )
+		return out->err ;
+	if( fflush(out->file) != 0 )	// anything the caller wrote with stdio comes first
+		out->err = 1 ;
+	int fd = fileno(out->file) ;
+	size_t done = 0 ;
+	while( out->err == 0 && done < out->length )
 	{
-		fprintf(stderr,"Block '%s' is truncated\n",strkey(KEY_swep)) ;
-		return 1 ;
+		ssize_t count = write(fd,out->data + done,out->length - done) ;
+		if( count < 0 && errno == EINTR )
+			continue ;
+		if( count <= 0 )
+		{
+			fprintf(stderr,"Cannot write output: %s\n",strerror(errno)) ;
+			out->err = 1 ;
+			break ;
+		}
+		done += count ;
 	}
-	struct block_swep *swep = (struct block_swep *)(node->data) ;
-	endian_fixup(&(swep->samplespersweep),sizeof(swep->samplespersweep)) ;
-	endian_fixup(&(swep->sweepstart),sizeof(swep->sweepstart)) ;
-	endian_fixup(&(swep->sweepbandwidth),sizeof(swep->sweepbandwidth)) ;
-	endian_fixup(&(swep->sweeprate),sizeof(swep->sweeprate)) ;
-	endian_fixup(&(swep->rangeoffset),sizeof(swep->rangeoffset)) ;
-	return 0 ;
+	out->length = 0 ;
+	return out->err ;
 }
 
-int dump_block_swep(struct node *node, struct config *config, FILE *outfile)
+char *out_reserve(struct output *out, size_t count)	// makes room for count more bytes, returns where they go or NULL on an error
+// the caller writes up to count bytes there and then adds what it used to out->length
 {
-	if( node->size < sizeof(struct block_swep) )
+	if( out->err )
+		return NULL ;
+	if( out->size - out->length < count && out->file != NULL )
+		out_flush(out) ;
+	if( out->size - out->length < count )	// a memory buffer, or a single piece bigger than the buffer
 	{
-		fprintf(stderr,"Block '%s' is truncated\n",strkey(KEY_swep)) ;
-		return 1 ;
+		size_t size = out->size*2 ;
+		if( size < out->length + count )
+			size = out->length + count ;
+		char *bigger = realloc(out->data,size) ;
+		if( bigger == NULL )
+		{
+			fprintf(stderr,"Cannot get memory for %zu bytes of output\n",size) ;
+			out->err = 1 ;
+		}
+		else
+		{
+			out->data = bigger ;
+			out->size = size ;
+		}
 	}
-	struct block_swep *swep = (struct block_swep *)(node->data) ;
-	fprintf(outfile,"%s\n",strkey(KEY_swep)) ;
-	fprintf(outfile,"samplespersweep:%d\n",swep->samplespersweep) ;
-	fprintf(outfile,"sweepstart:%.20lf\n",swep->sweepstart) ;
-	fprintf(outfile,"sweepbandwidth:%.20lf\n",swep->sweepbandwidth) ;
-	fprintf(outfile,"sweeprate:%.20lf\n",swep->sweeprate) ;
-	fprintf(outfile,"rangeoffset:%d\n",swep->rangeoffset) ;
-	fprintf(outfile,"\n") ;
-	return 0 ;
+	return out->err ? NULL : out->data + out->length ;
 }
 
-int make_node_swep(struct node *list, struct config *config, FILE *fd)		// creates a new node for swep block
+void out_text(struct output *out, const char *text, size_t length)	// appends length bytes of text
 {
-	struct node *newnode = malloc(sizeof(struct node)) ;
-	if( newnode == NULL )
-	{
-		fprintf(stderr,"Malloc error on list node\n") ;
-		return 1 ;
-	}
-	memset(newnode,0,sizeof(struct node)) ;
-	list->next = newnode ;
-	newnode->key = KEY_swep ;
-	struct block_swep *swep = malloc(sizeof(struct block_swep)) ;
-	if( swep == NULL )
-	{
-		fprintf(stderr,"Malloc error on data block\n") ;
-		return 1 ;
-	}
-	memset(swep,0,sizeof(struct block_swep)) ;
-	newnode->data = (unsigned char *)swep ;
-	newnode->size = sizeof(struct block_swep) ;
-	if( read_parameter(fd,"samplespersweep:%d",(void *)&(swep->samplespersweep)) ) return 1 ;
-	if( read_parameter(fd,"sweepstart:%lf",(void *)&(swep->sweepstart)) ) return 1 ;
-	if( read_parameter(fd,"sweepbandwidth:%lf",(void *)&(swep->sweepbandwidth)) ) return 1 ;
-	if( read_parameter(fd,"sweeprate:%lf",(void *)&(swep->sweeprate)) ) return 1 ;
-	if( read_parameter(fd,"rangeoffset:%d",(void *)&(swep->rangeoffset)) ) return 1 ;
-	return 0 ;
+	char *p = out_reserve(out,length) ;
+	if( p == NULL )
+		return ;
+	memcpy(p,text,length) ;
+	out->length += length ;
 }
 
-int gen_block_swep(struct node *node, FILE *outfile)
+void out_string(struct output *out, const char *text)	// appends a 0 terminated string
 {
-	struct block_swep *swep = (struct block_swep *)(node->data) ;
-	endian_fixup(&(node->key),sizeof(node->key)) ;
-	if( fwrite(&(node->key),sizeof(node->key),1,outfile) != 1 ) return 1 ;
-	endian_fixup(&(node->size),sizeof(node->size)) ;
-	if( fwrite(&(node->size),sizeof(node->size),1,outfile) != 1 ) return 1 ;
-	endian_fixup(&(swep->samplespersweep),sizeof(swep->samplespersweep)) ;
-	if( fwrite(&(swep->samplespersweep),sizeof(swep->samplespersweep),1,outfile) != 1 ) return 1 ;
-	endian_fixup(&(swep->sweepstart),sizeof(swep->sweepstart)) ;
-	if( fwrite(&(swep->sweepstart),sizeof(swep->sweepstart),1,outfile) != 1 ) return 1 ;
-	endian_fixup(&(swep->sweepbandwidth),sizeof(swep->sweepbandwidth)) ;
-	if( fwrite(&(swep->sweepbandwidth),sizeof(swep->sweepbandwidth),1,outfile) != 1 ) return 1 ;
-	endian_fixup(&(swep->sweeprate),sizeof(swep->sweeprate)) ;
-	if( fwrite(&(swep->sweeprate),sizeof(swep->sweeprate),1,outfile) != 1 ) return 1 ;
-	endian_fixup(&(swep->rangeoffset),sizeof(swep->rangeoffset)) ;
-	if( fwrite(&(swep->rangeoffset),sizeof(swep->rangeoffset),1,outfile) != 1 ) return 1 ;
-	return 0 ;
+	out_text(out,text,strlen(text)) ;
 }
 
-
-struct block_fbin
+void out_char(struct output *out, char c)
 {
-	fourcc bin_format ;	// format (normally 'cviq')
-	fourcc bin_type ;	// type of ALVL data ('flt8','flt4','fix4','fix3','fix2')
-} __attribute__((packed)) ;	// make sure there's no padding
+	if( out->length < out->size )
+		out->data[out->length++] = c ;
+	else
+		out_text(out,&c,1) ;
+}
 
-int fixup_data_fbin(struct node *node)
+void out_unsigned(struct output *out, uint64_t number)	// appends a number as "%" PRIu64 would
 {
-	if( node->size < sizeof(struct block_fbin) )
+	char digits[20] ;
+	int ndigits = 0 ;
+	do
 	{
-		fprintf(stderr,"Block '%s' is truncated\n",strkey(KEY_fbin)) ;
-		return 1 ;
-	}
-	struct block_fbin *fbin = (struct block_fbin *)node->data ;
-	endian_fixup(&(fbin->bin_format),sizeof(fbin->bin_format)) ;
-	endian_fixup(&(fbin->bin_type),sizeof(fbin->bin_type)) ;
-	return 0 ;
+		digits[ndigits++] = '0' + number % 10 ;
+		number /= 10 ;
+	} while( number != 0 ) ;
+	char *p = out_reserve(out,ndigits) ;
+	if( p == NULL )
+		return ;
+	out->length += ndigits ;
+	while( ndigits > 0 )
+		*p++ = digits[--ndigits] ;
 }
 
-int dump_block_fbin(struct node *node, struct config *config, FILE *outfile)
+void out_signed(struct output *out, int64_t number)	// appends a number as "%" PRId64 would
 {
-	if( node->size < sizeof(struct block_fbin) )
+	if( number < 0 )
 	{
-		fprintf(stderr,"Block '%s' is truncated\n",strkey(KEY_fbin)) ;
-		return 1 ;
+		out_char(out,'-') ;
+		out_unsigned(out,-(uint64_t )number) ;
 	}
-	struct block_fbin *fbin = (struct block_fbin *)(node->data) ;
-	config->bin_format = fbin->bin_format ;	// remember this for body data blocks
-	config->bin_type = fbin->bin_type ;	// remember this for body data blocks
-	fprintf(outfile,"%s\n",strkey(KEY_fbin)) ;
-	fprintf(outfile,"format:%s\n",strkey(fbin->bin_format)) ;
-	fprintf(outfile,"type:%s\n",strkey(fbin->bin_type)) ;
-	fprintf(outfile,"\n") ;
-	return 0 ;
+	else
+		out_unsigned(out,number) ;
 }
 
-int make_node_fbin(struct node *list, struct config *config, FILE *fd)		// creates a new node for fbin block
+void out_hex(struct output *out, uint32_t number)	// appends a number as "%x" would
 {
-	struct node *newnode = malloc(sizeof(struct node)) ;
-	if( newnode == NULL )
-	{
-		fprintf(stderr,"Malloc error on list node\n") ;
-		return 1 ;
-	}
-	memset(newnode,0,sizeof(struct node)) ;
-	list->next = newnode ;
-	newnode->key = KEY_fbin ;
-	struct block_fbin *fbin = malloc(sizeof(struct block_fbin)) ;
-	if( fbin == NULL )
+	char digits[8] ;
+	int ndigits = 0 ;
+	do
 	{
-		fprintf(stderr,"Malloc error on data block\n") ;
-		return 1 ;
-	}
-	memset(fbin,0,sizeof(struct block_fbin)) ;
-	newnode->data = (unsigned char *)fbin ;
-	newnode->size = sizeof(struct block_fbin) ;
-	char format[16] ;
-	sprintf(format,"format:%%%lus",sizeof(fbin->bin_format)) ;
-	if( read_parameter(fd,format,(void *)&(fbin->bin_format)) ) return 1 ;	// read as a 4 byte string
-	endian_fixup(&(fbin->bin_format),sizeof(fbin->bin_format)) ;		// then endian correct to 4 bytes int
-	sprintf(format,"type:%%%lus",sizeof(fbin->bin_type)) ;
-	if( read_parameter(fd,format,(void *)&(fbin->bin_type)) ) return 1 ;	// read as a 4 byte string
-	endian_fixup(&(fbin->bin_type),sizeof(fbin->bin_type)) ;		// then endian correct to 4 bytes int
-	config->bin_format = fbin->bin_format ;	// remember this for afft blocks
-	config->bin_type = fbin->bin_type ;	// remember this for afft blocks
-	if( Debug ) { fprintf(stderr,"debug: make_node_fbin: fbin->bin_format=%s fbin->bin_type=%s\n",strkey(fbin->bin_format),strkey(fbin->bin_type)) ; }
-	return 0 ;
+		digits[ndigits++] = "0123456789abcdef"[number & 0xf] ;
+		number >>= 4 ;
+	} while( number != 0 ) ;
+	char *p = out_reserve(out,ndigits) ;
+	if( p == NULL )
+		return ;
+	out->length += ndigits ;
+	while( ndigits > 0 )
+		*p++ = digits[--ndigits] ;
 }
 
-int gen_block_fbin(struct node *node, FILE *outfile)
+void out_double(struct output *out, double number, int precision)	// appends a number as "%.*lf" would
+// the doubles are the few header fields, so this leaves the rounding to snprintf()
 {
-	struct block_fbin *fbin = (struct block_fbin *)(node->data) ;
-	endian_fixup(&(node->key),sizeof(node->key)) ;
-	if( fwrite(&(node->key),sizeof(node->key),1,outfile) != 1 ) return 1 ;
-	endian_fixup(&(node->size),sizeof(node->size)) ;
-	if( fwrite(&(node->size),sizeof(node->size),1,outfile) != 1 ) return 1 ;
-	endian_fixup(&(fbin->bin_format),sizeof(fbin->bin_format)) ;
-	if( fwrite(&(fbin->bin_format),sizeof(fbin->bin_format),1,outfile) != 1 ) return 1 ;
-	endian_fixup(&(fbin->bin_type),sizeof(fbin->bin_type)) ;
-	if( fwrite(&(fbin->bin_type),sizeof(fbin->bin_type),1,outfile) != 1 ) return 1 ;
-	return 0 ;
+	size_t room = 32 + precision ;
+	for( int pass = 0 ; pass < 2 ; pass++ )
+	{
+		char *p = out_reserve(out,room) ;
+		if( p == NULL )
+			return ;
+		int length = snprintf(p,room,"%.*lf",precision,number) ;
+		if( length < 0 )
+			return ;
+		if( (size_t )length < room )
+		{
+			out->length += length ;
+			return ;
+		}
+		room = length + 1 ;	// a very large number, try again with the room it needs
+	}
 }
 
-
-int fixup_data_body(struct node *node)
+void out_float(struct output *out, float number)	// appends the shortest text that reads back as exactly number, see format_float()
 {
-	return 0 ;
+	char *p = out_reserve(out,SIZE_FLOAT_TEXT) ;
+	if( p == NULL )
+		return ;
+	out->length += format_float(number,p) ;
 }
 
-int dump_block_body(struct node *node, struct config *config, FILE *outfile)
+void out_hex_double(struct output *out, double number)	// appends a number as a C99 hex float, see format_hex()
 {
-	fprintf(outfile,"%s\n",strkey(KEY_BODY)) ;
-	fprintf(outfile,"\n") ;
-	return 0 ;
+	char *p = out_reserve(out,SIZE_HEX_TEXT) ;
+	if( p == NULL )
+		return ;
+	out->length += format_hex_double(number,p) ;
 }
 
-int make_node_body(struct node *list, struct config *config, FILE *fd)		// creates a new node for body block
+void out_key(struct output *out, fourcc key)	// appends a RIFF key as its 4 characters
 {
-	struct node *newnode = malloc(sizeof(struct node)) ;
-	if( newnode == NULL )
-	{
-		fprintf(stderr,"Malloc error\n") ;
-		return 1 ;
-	}
-	memset(newnode,0,sizeof(struct node)) ;
-	list->next = newnode ;
-	newnode->key = KEY_BODY ;
-	// fixup size at the very end
-	// no explicit data block, it's composed of sub blocks
-	return 0 ;
+	out_string(out,KEYNAME(key)) ;
 }
 
-int gen_block_body(struct node *node, FILE *outfile)
-{
-	endian_fixup(&(node->key),sizeof(node->key)) ;
-	if( fwrite(&(node->key),sizeof(node->key),1,outfile) != 1 ) return 1 ;
-	endian_fixup(&(node->size),sizeof(node->size)) ;
-	if( fwrite(&(node->size),sizeof(node->size),1,outfile) != 1 ) return 1 ;
-	return 0 ;
-}
 
+// Start of the block schema engine.
+// Every block type is described by its entry in Global_block_schemas, so there are just four generic functions, all driven by the schema.
+// The function swap_fields performs endian fixup on a data block, for fixup_block() in rsdump mode and on the copy written out by gen_fields.
+// The function dump_fields writes a text version of a block from a node. Used in rsdump mode.
+// The function make_fields reads a text version of the block and appends a node to the table. Used in rsgen mode.
+// The function gen_fields writes a binary RIFF block from a node. Used in rsgen mode.
 
-struct block_rtag
+void swap_run(unsigned char *data, int width, size_t count)	// swaps the byte order of count values of width bytes, a width of 0 swaps nothing
 {
-	uint32_t rtag ;		// receiver position (?)
-} __attribute__((packed)) ;	// make sure there's no padding
+	if( width == 4 )
+		endian_fixup_bulk4(data,count) ;
+	else if( width == 8 )
+		endian_fixup_bulk8(data,count) ;
+}
 
-int fixup_data_rtag(struct node *node)
+void swap_fields(const struct block_schema *schema, unsigned char *data, uint64_t size)	// swaps the byte order of the numeric fields of a data block of size bytes
 {
-	if( node->size < sizeof(struct block_rtag) )
+	size_t run_start = 0 ;		// neighbouring fields of the same width are swapped together, with one bulk swap
+	size_t run_count = 0 ;
+	int run_width = 0 ;
+	for( int i = 0 ; i < schema->nfields ; i++ )
 	{
-		fprintf(stderr,"Block '%s' is truncated\n",strkey(KEY_rtag)) ;
-		return 1 ;
+		const struct block_field *field = &(schema->fields[i]) ;
+		int width = Global_field_widths[field->type] ;
+		size_t count = 1 ;
+		if( field->type == FIELD_IQ )
+			count = (size - field->offset)/sizeof(struct block_iqdata_float)*2 ;	// the I and Q samples as one array of floats		// hardcoded type
+		if( width != 0 && width == run_width && field->offset == run_start + run_count*run_width )
+		{
+			run_count += count ;
+			continue ;
+		}
+		swap_run(data+run_start,run_width,run_count) ;
+		run_start = field->offset ;
+		run_width = width ;
+		run_count = width ? count : 0 ;
 	}
-	struct block_rtag *rtag = (struct block_rtag *)node->data ;
-	endian_fixup(&(rtag->rtag),sizeof(rtag->rtag)) ;			// fixup the endian order
-	return 0 ;
+	swap_run(data+run_start,run_width,run_count) ;
 }
 
-int dump_block_rtag(struct node *node, struct config *config, FILE *outfile)
+int dump_fields(const struct block_schema *schema, struct node *node, struct config *config, struct output *out)	// writes the text version of a block, a line for each field of its schema
 {
-	if( node->size < sizeof(struct block_rtag) )
-	{
-		fprintf(stderr,"Block '%s' is truncated\n",strkey(KEY_rtag)) ;
+	if( check_fields(schema,node,config,1) )
 		return 1 ;
+	take_config(schema,node,config) ;		// remember these values for later blocks
+	out_key(out,node->key) ;		// the schema for unknown blocks has no key of its own
+	out_char(out,'\n') ;
+	for( int i = 0 ; i < schema->nfields ; i++ )
+	{
+		const struct block_field *field = &(schema->fields[i]) ;
+		unsigned char *value = node->data + field->offset ;
+		switch( field->type )
+		{
+			case FIELD_KEY:
+			{
+				fourcc key ;
+				memcpy(&key,value,sizeof(key)) ;
+				out_string(out,field->name) ;
+				out_char(out,':') ;
+				out_key(out,key) ;
+				out_char(out,'\n') ;
+				break ;
+			}
+			case FIELD_HEX32:
+			case FIELD_UINT32:
+			{
+				uint32_t number ;
+				memcpy(&number,value,sizeof(number)) ;
+				out_string(out,field->name) ;
+				out_char(out,':') ;
+				if( field->type == FIELD_HEX32 )
+					out_hex(out,number) ;
+				else
+					out_unsigned(out,number) ;
+				out_char(out,'\n') ;
+				break ;
+			}
+			case FIELD_INT32:
+			{
+				int32_t number ;
+				memcpy(&number,value,sizeof(number)) ;
+				out_string(out,field->name) ;
+				out_char(out,':') ;
+				out_signed(out,number) ;
+				out_char(out,'\n') ;
+				break ;
+			}
+			case FIELD_DOUBLE:
+			{
+				double number ;
+				memcpy(&number,value,sizeof(number)) ;
+				out_string(out,field->name) ;
+				out_char(out,':') ;
+				if( out->hex )
+					out_hex_double(out,number) ;
+				else
+					out_double(out,number,field->count) ;
+				out_char(out,'\n') ;
+				break ;
+			}
+			case FIELD_TEXT:
+				out_string(out,field->name) ;
+				out_char(out,':') ;
+				out_text(out,(char *)value,strnlen((char *)value,field->count)) ;	// the text need not be terminated
+				out_char(out,'\n') ;
+				break ;
+			case FIELD_MACTIME:
+			{
+				uint32_t mactime ;
+				memcpy(&mactime,value,sizeof(mactime)) ;
+				time_t t = mactime ;
+				if( t != 0 )		// an unset time has no line
+				{
+					t -= MAC_EPOCH ;	// move epoc from 1904-01-01 00:00:00 to 1970-01-01 00:00:00
+					char timestring[SIZE_TIMESTRING] ;
+					char *text = ctime_r(&t,timestring) ;
+					out_string(out,field->name) ;
+					out_char(out,':') ;
+					out_unsigned(out,(unsigned long )t) ;
+					out_string(out," (NB: seconds since 1970) (") ;
+					out_text(out,text,strnlen(text,24)) ;		// leave out the newline
+					out_string(out,")\n") ;
+				}
+				break ;
+			}
+			case FIELD_BYTES:	// unknown structure, dump the raw data bytes
+				hexdump(field->name,value,node->size - field->offset,out) ;
+				break ;
+			case FIELD_IQ:
+			{
+				struct block_iqdata_float *iqdata = (struct block_iqdata_float *)value ;		// hardcoded type
+				size_t nsamples = (node->size - field->offset)/sizeof(struct block_iqdata_float) ;		// hardcoded type
+				for( size_t loop = 0 ; loop < nsamples ; loop++, iqdata++ )
+				{
+					char *line = out_reserve(out,SIZE_IQ_LINE) ;	// each line is formatted in place
+					if( line == NULL )
+						break ;
+					out->length += format_iq_line(loop,iqdata->isample,iqdata->qsample,out->hex,line) ;		// hardcoded type
+				}
+				break ;
+			}
+		}
 	}
-	struct block_rtag *rtag = (struct block_rtag *)(node->data) ;
-	fprintf(outfile,"%s\n",strkey(KEY_rtag)) ;
-	fprintf(outfile,"rtag:%u\n",rtag->rtag) ;
-	fprintf(outfile,"\n") ;
-	return 0 ;
+	if( !(schema->flags & SCHEMA_LAST) )
+		out_char(out,'\n') ;
+	return out->err ;
 }
 
-int make_node_rtag(struct node *list, struct config *config, FILE *fd)		// creates a new node for rtag block
+int check_fields(const struct block_schema *schema, struct node *node, struct config *config, int complain)	// returns 1 if dump_fields() cannot dump the block with this config, saying why if complain is set
 {
-	struct node *newnode = malloc(sizeof(struct node)) ;
-	if( newnode == NULL )
+	if( node->size < schema->size )
 	{
-		fprintf(stderr,"Malloc error on list node\n") ;
+		if( complain )
+			fprintf(stderr,"Block '%s' is truncated\n",KEYNAME(node->key)) ;
 		return 1 ;
 	}
-	memset(newnode,0,sizeof(struct node)) ;
-	list->next = newnode ;
-	newnode->key = KEY_rtag ;
-	struct block_rtag *rtag = malloc(sizeof(struct block_rtag)) ;
-	if( rtag == NULL )
+	for( int i = 0 ; i < schema->nfields ; i++ )
 	{
-		fprintf(stderr,"Malloc error on data block\n") ;
-		return 1 ;
+		if( schema->fields[i].type != FIELD_IQ )
+			continue ;
+		if( complain ? check_iqdata_format(config) : config->bin_format != BINFORMAT_CVIQ || config->bin_type != BINTYPE_FLT4 )
+			return 1 ;
 	}
-	memset(rtag,0,sizeof(struct block_rtag)) ;
-	newnode->data = (unsigned char *)rtag ;
-	newnode->size = sizeof(struct block_rtag) ;
-	if( read_parameter(fd,"rtag:%u",(void *)&(rtag->rtag)) ) return 1 ;
 	return 0 ;
 }
 
-int gen_block_rtag(struct node *node, FILE *outfile)
+void take_config(const struct block_schema *schema, struct node *node, struct config *config)	// copies the fields of a block that later blocks depend on into config
 {
-	struct block_rtag *rtag = (struct block_rtag *)(node->data) ;
-	endian_fixup(&(node->key),sizeof(node->key)) ;
-	if( fwrite(&(node->key),sizeof(node->key),1,outfile) != 1 ) return 1 ;
-	endian_fixup(&(node->size),sizeof(node->size)) ;
-	if( fwrite(&(node->size),sizeof(node->size),1,outfile) != 1 ) return 1 ;
-	endian_fixup(&(rtag->rtag),sizeof(rtag->rtag)) ;
-	if( fwrite(&(rtag->rtag),sizeof(rtag->rtag),1,outfile) != 1 ) return 1 ;
-	return 0 ;
-}
-
-struct block_gps1
-{
-	double lat ;				// GPS latitude in radians
-	double lon ;				// GPS longitude in radians
-	double alt ;				// GPS altitude in meters
-	int32_t gpstimestamp ;			// GPS timestamp in appletime
-} __attribute__((packed)) ;	// make sure there's no padding
-
-int fixup_data_gps1(struct node *node)
-{
-	if( node->size < sizeof(struct block_gps1) )
+	for( int i = 0 ; i < schema->nfields ; i++ )
 	{
-		fprintf(stderr,"Block '%s' is truncated\n",strkey(KEY_gps1)) ;
-		return 1 ;
+		const struct block_field *field = &(schema->fields[i]) ;
+		if( field->config != NO_CONFIG )
+			memcpy((unsigned char *)config + field->config,node->data + field->offset,Global_field_widths[field->type]) ;
 	}
-	struct block_gps1 *gps1 = (struct block_gps1 *)node->data ;
-	endian_fixup(&(gps1->lat),sizeof(gps1->lat)) ;				// fixup the endian order
-	endian_fixup(&(gps1->lon),sizeof(gps1->lon)) ;				// fixup the endian order
-	endian_fixup(&(gps1->alt),sizeof(gps1->alt)) ;				// fixup the endian order
-	endian_fixup(&(gps1->gpstimestamp),sizeof(gps1->gpstimestamp)) ;	// fixup the endian order
-	return 0 ;
 }
 
-int dump_block_gps1(struct node *node, struct config *config, FILE *outfile)
+int make_fields(const struct block_schema *schema, fourcc key, struct node_table *table, struct config *config, FILE *fd)	// reads the text version of a block with the given key, a line for each field of its schema, and appends a node for it to the table
 {
-	if( node->size < sizeof(struct block_gps1) )
+	struct node *newnode = new_node(table,key) ;
+	if( newnode == NULL )
+		return 1 ;
+	if( (schema->flags & SCHEMA_SUPERBLOCK) || schema->nfields == 0 )
+		return 0 ;	// no explicit data block, a superblock is composed of sub blocks and its size is fixed up at the very end
+	size_t size = schema->size ;
+	size_t nvalues = 0 ;			// the number of I/Q samples or raw bytes in the last field, which may vary in length
+	unsigned char *bytes = NULL ;
+	const struct block_field *last = &(schema->fields[schema->nfields-1]) ;
+	if( last->type == FIELD_IQ )
+	{
+		nvalues = count_iqdata_lines(fd) ;		// count lines, 1 line per sample (i and q), use this to malloc space for the entire block
+		if( nvalues == 0 )
+		{
+			fprintf(stderr,"Error counting lines in '%s' block\n",KEYNAME(key)) ;
+			return 1 ;
+		}
+		if( nvalues % 3 != 0 )
+		{
+			fprintf(stderr,"Bad number of lines: %zu, reading '%s' block. Lines must be a multiple of 3\n",nvalues,KEYNAME(key)) ;
+			return 1 ;
+		}
+		size = last->offset + nvalues*sizeof(struct block_iqdata_float) ;		// hardcoded type
+	}
+	else if( last->type == FIELD_BYTES )
+	{
+		int err = read_hex_bytes(fd,&bytes,&nvalues) ;
+		if( err )
+			return err ;
+		size = last->offset + nvalues ;
+	}
+	if( Debug ) { fprintf(stderr,"debug: make_fields: block '%s' size=%zu\n",KEYNAME(key),size) ; }
+	unsigned char *data = malloc(size) ;
+	if( data == NULL )
 	{
-		fprintf(stderr,"Block '%s' is truncated\n",strkey(KEY_gps1)) ;
+		fprintf(stderr,"Malloc error on data block\n") ;
+		free(bytes) ;
 		return 1 ;
 	}
-	struct block_gps1 *gps1 = (struct block_gps1 *)(node->data) ;
-	uint32_t gpstimestamp = gps1->gpstimestamp ;
-	time_t t = gpstimestamp ;
-	fprintf(outfile,"%s\n",strkey(KEY_gps1)) ;
-	fprintf(outfile,"lat:%.6lf\n",gps1->lat) ;
-	fprintf(outfile,"lon:%.6lf\n",gps1->lon) ;
-	fprintf(outfile,"alt:%.6lf\n",gps1->alt) ;
-	if( t != 0 )
+	memset(data,0,size) ;
+	newnode->data = data ;
+	newnode->size = size ;
+	if( bytes != NULL )
+	{
+		memcpy(data+last->offset,bytes,nvalues) ;
+		free(bytes) ;
+	}
+	char format[SIZE_LINE] ;
+	for( int i = 0 ; i < schema->nfields ; i++ )
 	{
-		t -= 2082844800 ;	// move epoc from 1904-01-01 00:00:00 to 1970-01-01 00:00:00 
-		fprintf(outfile,"gpstimestamp:%lu (NB: seconds since 1970) (%.24s)\n",t,ctime(&t)) ;
+		const struct block_field *field = &(schema->fields[i]) ;
+		unsigned char *value = data + field->offset ;
+		int err = 0 ;
+		switch( field->type )
+		{
+			case FIELD_KEY:
+				snprintf(format,SIZE_LINE,"%s:%%4c",field->name) ;
+				err = read_parameter(fd,format,value) ;		// read as 4 characters
+				endian_fixup(value,sizeof(fourcc)) ;		// then endian correct to a 4 byte int
+				break ;
+			case FIELD_HEX32:
+				snprintf(format,SIZE_LINE,"%s:%%x",field->name) ;
+				err = read_parameter(fd,format,value) ;
+				break ;
+			case FIELD_UINT32:
+				snprintf(format,SIZE_LINE,"%s:%%u",field->name) ;
+				err = read_parameter(fd,format,value) ;
+				break ;
+			case FIELD_INT32:
+				snprintf(format,SIZE_LINE,"%s:%%d",field->name) ;
+				err = read_parameter(fd,format,value) ;
+				break ;
+			case FIELD_DOUBLE:
+				snprintf(format,SIZE_LINE,"%s:%%lf",field->name) ;
+				err = read_parameter(fd,format,value) ;
+				break ;
+			case FIELD_TEXT:
+				snprintf(format,SIZE_LINE,"%s:%%%dc",field->name,field->count) ;
+				err = read_parameter(fd,format,value) ;
+				break ;
+			case FIELD_MACTIME:
+			{
+				snprintf(format,SIZE_LINE,"%s:%%u",field->name) ;
+				uint32_t mactime = 0 ;
+				err = read_parameter(fd,format,&mactime) ;
+				mactime += MAC_EPOCH ;	// move epoc from 1970-01-01 00:00:00 to 1904-01-01 00:00:00
+				memcpy(value,&mactime,sizeof(mactime)) ;
+				break ;
+			}
+			case FIELD_BYTES:	// already copied
+				break ;
+			case FIELD_IQ:
+				err = read_iqdata_samples((struct block_iqdata_float *)value,nvalues,config,fd) ;	// read lines of i, q values as float
+				if( err )
+					fprintf(stderr,"Error reading '%s' block\n",KEYNAME(key)) ;
+				break ;
+		}
+		if( err )
+			return 1 ;
+		if( field->config != NO_CONFIG )
+			memcpy((unsigned char *)config + field->config,value,Global_field_widths[field->type]) ;	// remember this for later blocks
 	}
-	fprintf(outfile,"\n") ;
 	return 0 ;
 }
 
-int make_node_gps1(struct node *list, struct config *config, FILE *fd)		// creates a new node for gps1 block
+int gen_fields(const struct block_schema *schema, struct node *node, FILE *outfile)	// writes the binary version of a block, its header and data with a single fwrite
 {
-	struct node *newnode = malloc(sizeof(struct node)) ;
-	if( newnode == NULL )
+	uint64_t length_data = (schema->flags & SCHEMA_SUPERBLOCK) ? 0 : node->size ;	// a superblock's size covers its sub blocks, which are written after it
+	int swapped = 0 ;
+	for( int i = 0 ; i < schema->nfields ; i++ )
+		swapped |= Global_field_widths[schema->fields[i].type] != 0 ;
+	if( !swapped )		// raw data, such as an unknown block, is written straight from the node without a copy
 	{
-		fprintf(stderr,"Malloc error on list node\n") ;
-		return 1 ;
+		unsigned char header[sizeof(struct block_header) + sizeof(uint64_t)] ;
+		unsigned int length_header = encode_block_header(node,header) ;
+		if( fwrite(header,length_header,1,outfile) != 1 ) return 1 ;
+		if( length_data > 0 && fwrite(node->data,length_data,1,outfile) != 1 ) return 1 ;
+		return 0 ;
 	}
-	memset(newnode,0,sizeof(struct node)) ;
-	list->next = newnode ;
-	newnode->key = KEY_gps1 ;
-	struct block_gps1 *gps1 = malloc(sizeof(struct block_gps1)) ;
-	if( gps1 == NULL )
+	unsigned int length_header = header_size(node->size) ;
+	unsigned char *buffer = malloc(length_header + length_data) ;
+	if( buffer == NULL )
 	{
 		fprintf(stderr,"Malloc error on data block\n") ;
 		return 1 ;
 	}
-	memset(gps1,0,sizeof(struct block_gps1)) ;
-	newnode->data = (unsigned char *)gps1 ;
-	newnode->size = sizeof(struct block_gps1) ;
-	if( read_parameter(fd,"lat:%lf",(void *)&(gps1->lat)) ) return 1 ;
-	if( read_parameter(fd,"lon:%lf",(void *)&(gps1->lon)) ) return 1 ;
-	if( read_parameter(fd,"alt:%lf",(void *)&(gps1->alt)) ) return 1 ;
-	if( read_parameter(fd,"gpstimestamp:%u",(void *)&(gps1->gpstimestamp)) ) return 1 ;
-	gps1->gpstimestamp += 2082844800 ;	// move epoc from 1970-01-01 00:00:00 to 1904-01-01 00:00:00 
-	return 0 ;
+	encode_block_header(node,buffer) ;
+	if( length_data > 0 )
+	{
+		memcpy(buffer+length_header,node->data,length_data) ;
+		swap_fields(schema,buffer+length_header,length_data) ;	// swap a copy, the node is left in host byte order
+	}
+	int err = fwrite(buffer,length_header + length_data,1,outfile) != 1 ;
+	free(buffer) ;
+	return err ;
 }
 
-int gen_block_gps1(struct node *node, FILE *outfile)
+void hexdump(const char *name, unsigned char *data, uint64_t size, struct output *out)	// writes a line with a label and then each byte in hex
 {
-	struct block_gps1 *gps1 = (struct block_gps1 *)(node->data) ;
-	endian_fixup(&(node->key),sizeof(node->key)) ;
-	if( fwrite(&(node->key),sizeof(node->key),1,outfile) != 1 ) return 1 ;
-	endian_fixup(&(node->size),sizeof(node->size)) ;
-	if( fwrite(&(node->size),sizeof(node->size),1,outfile) != 1 ) return 1 ;
-	endian_fixup(&(gps1->lat),sizeof(gps1->lat)) ;
-	if( fwrite(&(gps1->lat),sizeof(gps1->lat),1,outfile) != 1 ) return 1 ;
-	endian_fixup(&(gps1->lon),sizeof(gps1->lon)) ;
-	if( fwrite(&(gps1->lon),sizeof(gps1->lon),1,outfile) != 1 ) return 1 ;
-	endian_fixup(&(gps1->alt),sizeof(gps1->alt)) ;
-	if( fwrite(&(gps1->alt),sizeof(gps1->alt),1,outfile) != 1 ) return 1 ;
-	endian_fixup(&(gps1->gpstimestamp),sizeof(gps1->gpstimestamp)) ;
-	if( fwrite(&(gps1->gpstimestamp),sizeof(gps1->gpstimestamp),1,outfile) != 1 ) return 1 ;
-	return 0 ;
+	uint64_t loop ;
+	out_string(out,name) ;
+	out_char(out,':') ;
+	for( loop = 0 ; loop < size ; loop++, data++ )
+	{
+		char *p = out_reserve(out,3) ;
+		if( p == NULL )
+			return ;
+		p[0] = ' ' ;
+		p[1] = "0123456789abcdef"[data[0] >> 4] ;
+		p[2] = "0123456789abcdef"[data[0] & 0xf] ;
+		out->length += 3 ;
+	}
+	out_char(out,'\n') ;
 }
 
-
-struct block_indx
-{
-	uint32_t index ;		// index
-} __attribute__((packed)) ;	// make sure there's no padding
-
-int fixup_data_indx(struct node *node)
+int read_hex_bytes(FILE *fd, unsigned char **bytes, size_t *count)	// reads the line written by hexdump() into a malloc'd array of any length, returns -1 at the end of the file
 {
-	if( node->size < sizeof(struct block_indx) )
+	char *line = NULL ;
+	size_t length = 0 ;
+	if( getline(&line,&length,fd) < 0 )
 	{
-		fprintf(stderr,"Block '%s' is truncated\n",strkey(KEY_indx)) ;
+		if( Debug ) { fprintf(stderr,"debug: read_hex_bytes: getline found no line\n") ; }
+		free(line) ;
+		return -1 ;
+	}
+	unsigned char *data = malloc(strlen(line)/2 + 1) ;	// each byte takes at least 2 characters, a space and a digit
+	if( data == NULL )
+	{
+		fprintf(stderr,"Malloc error on data block\n") ;
+		free(line) ;
 		return 1 ;
 	}
-	struct block_indx *indx = (struct block_indx *)node->data ;
-	endian_fixup(&(indx->index),sizeof(indx->index)) ;			// fixup the endian order
+	// split the line into space-separated args, the first is the label
+	char sep[] = " \n" ;
+	char *saveptr = NULL ;
+	size_t argc = 0 ;
+	strtok_r(line,sep,&saveptr) ;
+	for( char *arg = strtok_r(NULL,sep,&saveptr) ; arg != NULL ; arg = strtok_r(NULL,sep,&saveptr) )
+		data[argc++] = (unsigned char )strtoul(arg,NULL,16) ;
+	if( Debug ) { fprintf(stderr,"debug: read_hex_bytes: counted %zu bytes of data\n",argc) ; }
+	free(line) ;
+	*bytes = data ;
+	*count = argc ;
 	return 0 ;
 }
 
-int dump_block_indx(struct node *node, struct config *config, FILE *outfile)
+size_t count_iqdata_lines(FILE *fd)		// count how many lines of i,q data there are before we hit a blank line (end of block)
 {
-	if( node->size < sizeof(struct block_indx) )
+	char line[SIZE_LINE] ;
+	size_t count = 0 ;
+	off_t afft_start = ftello(fd) ;
+	while( fgets(line,SIZE_LINE,fd) != NULL )
 	{
-		fprintf(stderr,"Block '%s' is truncated\n",strkey(KEY_indx)) ;
-		return 1 ;
+		chomp(line,SIZE_LINE) ;				// remove newline
+		if( strlen(line) < 1 )
+			break ;
+		count++ ;
 	}
-	struct block_indx *indx = (struct block_indx *)(node->data) ;
-	config->index = indx->index ;
-	fprintf(outfile,"%s\n",strkey(KEY_indx)) ;
-	fprintf(outfile,"index:%u\n",indx->index) ;
-	fprintf(outfile,"\n") ;
-	return 0 ;
+	fseeko(fd,afft_start,SEEK_SET) ;
+	return count ;
 }
 
-int make_node_indx(struct node *list, struct config *config, FILE *fd)		// creates a new node for indx block
+int check_iqdata_format(struct config *config)	// complains and returns 1 unless the fbin block gave a format and type of I/Q data that can be handled
 {
-	struct node *newnode = malloc(sizeof(struct node)) ;
-	if( newnode == NULL )
+	if( (uint32_t )config->bin_format != BINFORMAT_CVIQ )
 	{
-		fprintf(stderr,"Malloc error on list node\n") ;
+		fprintf(stderr,"Cannot handle BINFORMAT %u\n",(uint32_t )config->bin_format) ;
 		return 1 ;
 	}
-	memset(newnode,0,sizeof(struct node)) ;
-	list->next = newnode ;
-	newnode->key = KEY_indx ;
-	struct block_indx *indx = malloc(sizeof(struct block_indx)) ;
-	if( indx == NULL )
+	if( (uint32_t )config->bin_type != BINTYPE_FLT4 )
 	{
-		fprintf(stderr,"Malloc error on data block\n") ;
+		fprintf(stderr,"Cannot handle BINTYPE %u\n",(uint32_t )config->bin_type) ;
 		return 1 ;
 	}
-	memset(indx,0,sizeof(struct block_indx)) ;
-	newnode->data = (unsigned char *)indx ;
-	newnode->size = sizeof(struct block_indx) ;
-	if( read_parameter(fd,"index:%u",(void *)&(indx->index)) ) return 1 ;
 	return 0 ;
 }
 
-int gen_block_indx(struct node *node, FILE *outfile)
+int read_iqdata_samples(struct block_iqdata_float *iqdata, size_t iqsamples, struct config *config, FILE *fd)		// hardcoded type
 {
-	struct block_indx *indx = (struct block_indx *)(node->data) ;
-	endian_fixup(&(node->key),sizeof(node->key)) ;
-	if( fwrite(&(node->key),sizeof(node->key),1,outfile) != 1 ) return 1 ;
-	endian_fixup(&(node->size),sizeof(node->size)) ;
-	if( fwrite(&(node->size),sizeof(node->size),1,outfile) != 1 ) return 1 ;
-	endian_fixup(&(indx->index),sizeof(indx->index)) ;
-	if( fwrite(&(indx->index),sizeof(indx->index),1,outfile) != 1 ) return 1 ;
+	char line[SIZE_LINE] ;
+	if( check_iqdata_format(config) )
+		return 1 ;
+	for( size_t sample_count = 0 ; sample_count < iqsamples ; sample_count++, iqdata++ )
+	{
+		if( fgets(line,SIZE_LINE,fd) == NULL ) return 1 ;
+		chomp(line,SIZE_LINE) ;
+		if( strlen(line) == 0 ) return 1 ;
+		char *start = line ;
+		char *end ;
+		float i ;
+		float q ;
+		strtol(start,&end,10) ;		// the index is only there for people, it is not checked
+		if( end == start || parse_float(end,&start,&i) || parse_float(start,&end,&q) )	// read as floats, so there is no double rounding
+		{
+			fprintf(stderr,"Failed to read iqdata %zu from line %s\n",sample_count,line) ;
+			return 1 ;
+		}
+		iqdata->isample = i ;			// hardcoded type
+		iqdata->qsample = q ;			// hardcoded type
+		//if( Debug && (sample_count == 0) ) { fprintf(stderr,"debug: read_iqdata_samples: double i=%lf q=%lf, scalar_one=%lf scalar_two=%lf, factor=%lf int i=%d q=%d\n",i,q,config->scalar_one,config->scalar_two,factor,iqdata->isample,iqdata->qsample) ; }
+	}
 	return 0 ;
 }
 
 
-struct block_scal
-{
-	double scalar_one ;		// scaling value for I samples
-	double scalar_two ;		// scaling value for Q samples
-} __attribute__((packed)) ;	// make sure there's no padding
+// end of the block schema engine
+
 
-int fixup_data_scal(struct node *node)
+// Recovery of damaged files, for rsdump -r.
+// Instead of trusting the superblock sizes, the file is scanned one block header at a time, and a header counts only if its key is in
+// Global_registry and its size fits the file. A block with an unknown key, from newer firmware, counts if its key is alphanumeric, it fits,
+// and the block after it is plausible too, see plausible_unknown(). After a bad header the scan skips ahead to the next known key.
+// Blocks other than the sweep blocks are kept with the sweep they are in.
+// The sweeps are then rebuilt from the blocks that were found. A sweep that was cut short by damage, or that begins after damage with a block
+// other than the one every sweep starts with, is left out, so the dump holds only intact sweeps.
+
+int parse_recover(struct node_table *table, unsigned char *file, uint64_t length, int *damaged)	// rebuilds the table of nodes of a possibly damaged file
+// sets damaged if any part of the file had to be skipped or left out, returns 1 only if the table cannot grow
 {
-	if( node->size < sizeof(struct block_scal) )
+	*damaged = 0 ;
+	struct recovered_sweep *sweeps = NULL ;
+	size_t nsweeps = 0 ;
+	size_t capacity = 0 ;
+	long current = -1 ;				// the sweep being filled in, -1 after a block that isn't a sweep block or a damaged stretch
+	uint64_t offset = 0 ;
+	while( offset < length )
 	{
-		fprintf(stderr,"Block '%s' is truncated\n",strkey(KEY_scal)) ;
-		return 1 ;
+		struct node node ;
+		unsigned int length_header = plausible_header(file,offset,length,&node) ;
+		if( length_header == 0 )
+		{
+			uint64_t start = offset ;
+			do
+				offset = find_block_key(file,offset+1,length) ;
+			while( offset < length && plausible_header(file,offset,length,&node) == 0 ) ;
+			if( offset == length && length - start >= sizeof(struct block_header) && known_key(node.key) )
+				fprintf(stderr,"Block '%s' at offset %" PRIu64 " is truncated\n",KEYNAME(node.key),start) ;
+			else
+				fprintf(stderr,"Damaged data at offset %" PRIu64 ", skipped %" PRIu64 " bytes\n",start,offset-start) ;
+			*damaged = 1 ;
+			if( current >= 0 )
+				sweeps[current].broken = 1 ;	// the rest of it may have been in the damaged stretch
+			current = -1 ;
+			continue ;
+		}
+		struct node *newnode = new_node(table,node.key) ;
+		if( newnode == NULL )
+		{
+			free(sweeps) ;
+			return 1 ;
+		}
+		offset += length_header ;
+		newnode->size = node.size ;
+		newnode->offset = offset ;
+		newnode->data = file + offset ;
+		if( superblock(node.key) )	// its sub-blocks follow, the size isn't trusted
+		{
+			if( newnode->size > length - offset )
+				newnode->size = length - offset ;
+			current = -1 ;
+			continue ;
+		}
+		newnode->bigendian = 1 ;
+		offset += node.size ;
+		int slot = sweep_key_slot(node.key) ;
+		if( slot < 0 )		// another block, in the sweep it is found in, if there is one
+		{
+			if( current >= 0 )
+				sweeps[current].count++ ;
+			continue ;
+		}
+		if( current < 0 || (sweeps[current].found >> slot) != 0 )	// the blocks of a sweep come in the order of Global_sweep_keys, so this one starts a sweep
+		{
+			if( nsweeps == capacity )
+			{
+				capacity = capacity ? 2*capacity : 256 ;
+				struct recovered_sweep *bigger = realloc(sweeps,capacity*sizeof(struct recovered_sweep)) ;
+				if( bigger == NULL )
+				{
+					fprintf(stderr,"Malloc error on recovered sweeps\n") ;
+					free(sweeps) ;
+					return 1 ;
+				}
+				sweeps = bigger ;
+			}
+			current = nsweeps++ ;
+			sweeps[current].first = table->count - 1 ;
+			sweeps[current].count = 0 ;
+			sweeps[current].found = 0 ;
+			sweeps[current].broken = 0 ;
+		}
+		sweeps[current].count++ ;
+		sweeps[current].found |= 1u << slot ;
+	}
+	unsigned int found = 0 ;
+	for( size_t count = 0 ; count < nsweeps ; count++ )
+		found |= sweeps[count].found ;
+	fourcc first_key = found ? Global_sweep_keys[__builtin_ctz(found)] : 0 ;	// the block that sweeps start with
+	size_t merged = 0 ;				// a fragment right after a sweep cut short by damage is the rest of that sweep, not another one
+	for( size_t count = 0 ; count < nsweeps ; count++ )
+	{
+		struct recovered_sweep *previous = merged > 0 ? &(sweeps[merged-1]) : NULL ;
+		if( previous != NULL && previous->broken && table->nodes[sweeps[count].first].key != first_key
+			&& sweeps[count].first == previous->first + previous->count )
+		{
+			previous->count += sweeps[count].count ;
+			previous->found |= sweeps[count].found ;
+		}
+		else
+			sweeps[merged++] = sweeps[count] ;
+	}
+	nsweeps = merged ;
+	for( size_t count = 0 ; count < nsweeps ; count++ )
+	{
+		if( table->nodes[sweeps[count].first].key != first_key )	// the start of it was in a damaged stretch
+			sweeps[count].broken = 1 ;
+	}
+	size_t kept = 0 ;				// drop the broken sweeps, and set depth and parent from the keys, as the superblock sizes can't be trusted
+	size_t intact = 0 ;
+	size_t sweep = 0 ;
+	long latest[3] = { -1, -1, -1 } ;		// the latest kept node at each depth
+	for( size_t count = 0 ; count < table->count ; count++ )
+	{
+		while( sweep < nsweeps && count >= sweeps[sweep].first + sweeps[sweep].count )
+			sweep++ ;
+		if( sweep < nsweeps && count == sweeps[sweep].first && !sweeps[sweep].broken )
+			intact++ ;
+		if( sweep < nsweeps && count >= sweeps[sweep].first && sweeps[sweep].broken )
+			continue ;
+		struct node *node = &(table->nodes[kept]) ;
+		*node = table->nodes[count] ;
+		if( node->key == KEY_AQFT || node->key == KEY_END )
+			node->depth = 0 ;
+		else if( superblock(node->key) )
+			node->depth = 1 ;
+		else
+			node->depth = 2 ;
+		node->parent = node->depth > 0 ? latest[node->depth-1] : -1 ;
+		latest[node->depth] = kept++ ;
+	}
+	table->count = kept ;
+	if( intact < nsweeps )
+	{
+		fprintf(stderr,"Recovered %zu of %zu sweeps\n",intact,nsweeps) ;
+		*damaged = 1 ;
 	}
-	struct block_scal *scal = (struct block_scal *)node->data ;
-	endian_fixup(&(scal->scalar_one),sizeof(scal->scalar_one)) ;
-	endian_fixup(&(scal->scalar_two),sizeof(scal->scalar_two)) ;
+	free(sweeps) ;
 	return 0 ;
 }
 
-int dump_block_scal(struct node *node, struct config *config, FILE *outfile)
+unsigned int plausible_header(unsigned char *file, uint64_t offset, uint64_t length, struct node *node)	// decodes the block header at offset into node, if it could be genuine
+// returns the length of the header, or 0 if the block doesn't fit in the file or has an unknown key that doesn't pass plausible_unknown()
+// superblocks may run past the end, as they do in a truncated file, but afft and ifft blocks must hold whole samples
 {
-	if( node->size < sizeof(struct block_scal) )
-	{
-		fprintf(stderr,"Block '%s' is truncated\n",strkey(KEY_scal)) ;
-		return 1 ;
-	}
-	struct block_scal *scal = (struct block_scal *)(node->data) ;
-	config->scalar_one = scal->scalar_one ;	// remember this for iqdata blocks
-	config->scalar_two = scal->scalar_two ;	// remember this for iqdata blocks
-	fprintf(outfile,"%s\n",strkey(KEY_scal)) ;
-	fprintf(outfile,"scalar_one:%.20lf\n",scal->scalar_one) ;
-	fprintf(outfile,"scalar_two:%.20lf\n",scal->scalar_two) ;
-	fprintf(outfile,"\n") ;
-	return 0 ;
+	memset(node,0,sizeof(struct node)) ;
+	if( length - offset < sizeof(struct block_header) )
+		return 0 ;
+	struct block_header *header = (struct block_header *)(file+offset) ;
+	node->key = header->key ;
+	endian_fixup(&(node->key),sizeof(node->key)) ;
+	if( !known_key(node->key) )
+		return plausible_unknown(file,offset,length,node) ;
+	unsigned int length_header = decode_block_header(file+offset,length-offset,node) ;
+	if( length_header == 0 )
+		return 0 ;
+	if( superblock(node->key) )
+		return length_header ;
+	if( node->size > length - offset - length_header )
+		return 0 ;
+	if( (node->key == KEY_afft || node->key == KEY_ifft) && node->size % sizeof(struct block_iqdata_float) != 0 )
+		return 0 ;
+	return length_header ;
 }
 
-int make_node_scal(struct node *list, struct config *config, FILE *fd)		// creates a new node for scal block
+unsigned int plausible_unknown(unsigned char *file, uint64_t offset, uint64_t length, struct node *node)	// decodes the header at offset of a block with an unknown key, if it could be genuine
+// the key must be 4 letters, digits or spaces and the block must fit in the file, and so must the blocks after it up to one with a known
+// key, which must be plausible, or the end of the file; returns the length of the header or 0
+// a key one or two bytes away from a known key, or a block whose data starts with a known block, is more likely a damaged key than a new one
 {
-	struct node *newnode = malloc(sizeof(struct node)) ;
-	if( newnode == NULL )
-	{
-		fprintf(stderr,"Malloc error on list node\n") ;
-		return 1 ;
-	}
-	memset(newnode,0,sizeof(struct node)) ;
-	list->next = newnode ;
-	newnode->key = KEY_scal ;
-	struct block_scal *scal = malloc(sizeof(struct block_scal)) ;
-	if( scal == NULL )
+	unsigned int length_header = 0 ;
+	uint64_t next = offset ;
+	for( int run = 0 ; run < MAX_UNKNOWN_RUN ; run++ )
 	{
-		fprintf(stderr,"Malloc error on data block\n") ;
-		return 1 ;
+		if( length - next < sizeof(struct block_header) )
+			return 0 ;
+		struct node block ;
+		memset(&block,0,sizeof(struct node)) ;
+		for( int i = 0 ; i < (int )sizeof(fourcc) ; i++ )
+		{
+			unsigned char c = file[next+i] ;
+			if( !((c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || c == ' ') )	// as in RIFF keys, not isalnum(), which depends on the locale
+				return 0 ;
+		}
+		unsigned int header = decode_block_header(file+next,length-next,&block) ;
+		if( header == 0 || block.size > length - next - header || damaged_key(block.key) )
+			return 0 ;
+		if( block.size >= sizeof(struct block_header) )		// a superblock with a damaged key holds known blocks
+		{
+			struct node inside ;
+			fourcc key ;
+			memcpy(&key,file+next+header,sizeof(key)) ;
+			endian_fixup(&key,sizeof(key)) ;
+			if( known_key(key) && plausible_header(file,next+header,next+header+block.size,&inside) )
+				return 0 ;
+		}
+		if( run == 0 )
+		{
+			*node = block ;
+			length_header = header ;
+		}
+		next += header + block.size ;
+		if( next == length )
+			return length_header ;
+		if( length - next >= sizeof(fourcc) )
+		{
+			fourcc key ;
+			memcpy(&key,file+next,sizeof(key)) ;
+			endian_fixup(&key,sizeof(key)) ;
+			if( known_key(key) )
+				return plausible_header(file,next,length,&block) ? length_header : 0 ;
+		}
 	}
-	memset(scal,0,sizeof(struct block_scal)) ;
-	newnode->data = (unsigned char *)scal ;
-	newnode->size = sizeof(struct block_scal) ;
-	if( read_parameter(fd,"scalar_one:%lf",(void *)&(scal->scalar_one)) ) return 1 ;
-	if( read_parameter(fd,"scalar_two:%lf",(void *)&(scal->scalar_two)) ) return 1 ;
-	config->scalar_one = scal->scalar_one ;	// remember this for iqdata blocks
-	config->scalar_two = scal->scalar_two ;	// remember this for iqdata blocks
 	return 0 ;
 }
 
-int gen_block_scal(struct node *node, FILE *outfile)
+int damaged_key(fourcc key)	// returns 1 if key differs from a key in Global_registry in only one or two bytes
 {
-	struct block_scal *scal = (struct block_scal *)(node->data) ;
-	endian_fixup(&(node->key),sizeof(node->key)) ;
-	if( fwrite(&(node->key),sizeof(node->key),1,outfile) != 1 ) return 1 ;
-	endian_fixup(&(node->size),sizeof(node->size)) ;
-	if( fwrite(&(node->size),sizeof(node->size),1,outfile) != 1 ) return 1 ;
-	endian_fixup(&(scal->scalar_one),sizeof(scal->scalar_one)) ;
-	if( fwrite(&(scal->scalar_one),sizeof(scal->scalar_one),1,outfile) != 1 ) return 1 ;
-	endian_fixup(&(scal->scalar_two),sizeof(scal->scalar_two)) ;
-	if( fwrite(&(scal->scalar_two),sizeof(scal->scalar_two),1,outfile) != 1 ) return 1 ;
+	for( int k = 0 ; k < Global_registry.count ; k++ )
+	{
+		fourcc diff = key ^ Global_registry.schemas[k]->key ;
+		int bytes = 0 ;
+		for( ; diff != 0 ; diff >>= 8 )
+			bytes += (diff & 0xff) != 0 ;
+		if( bytes > 0 && bytes <= 2 )
+			return 1 ;
+	}
 	return 0 ;
 }
 
-
-struct block_iqdata_float		// hardcoded type
+int known_key(fourcc key)	// returns 1 if key is in Global_registry, without complaining if it isn't
 {
-	float isample ;		// I sample		// hardcoded type
-	float qsample ;		// Q sample		// hardcoded type
-} __attribute__((packed)) ;	// make sure there's no padding
+	return lookup_block_schema(key) != NULL ;
+}
 
-int fixup_data_afft(struct node *node)
+uint64_t find_block_key(unsigned char *file, uint64_t offset, uint64_t length)	// returns the offset of the next known block key at or after offset, or length if there is none
+// the vector loops test the first two bytes at 16 or 32 positions at once, and only the positions that pass are checked in full
+// with SSSE3 or AVX2 each byte is classified by two table lookups on its nibbles, giving a bit for each group of keys it could start (or continue)
+// the bits for a position's first byte and the next byte are ANDed, so only a rare false match gets as far as known_key()
 {
-	if( node->size < sizeof(struct block_iqdata_float) )
+	unsigned char low_first[16] = { 0 } ;		// the groups of keys whose first byte has a given low nibble
+	unsigned char high_first[16] = { 0 } ;		// ... a given high nibble
+	unsigned char low_second[16] = { 0 } ;		// the same for the second byte
+	unsigned char high_second[16] = { 0 } ;
+	int nkeys = Global_registry.count ;
+	for( int k = 0 ; k < nkeys ; k++ )
 	{
-		fprintf(stderr,"Block '%s' is truncated\n",strkey(KEY_afft)) ;
-		return 1 ;
+		fourcc key = Global_registry.schemas[k]->key ;
+		unsigned char group = 1 << (k % 8) ;
+		unsigned char first = key >> 24 ;	// keys are stored bigendian, so the top byte comes first
+		unsigned char second = key >> 16 ;
+		low_first[first & 0x0f] |= group ;
+		high_first[first >> 4] |= group ;
+		low_second[second & 0x0f] |= group ;
+		high_second[second >> 4] |= group ;
 	}
-	struct block_iqdata_float *afft = (struct block_iqdata_float *)node->data ;		// hardcoded type
-	int nsamples = (node->size)/sizeof(struct block_iqdata_float) ;		// hardcoded type
-	for( int loop = 0 ; loop < nsamples ; loop++, afft++ )
+	uint64_t i = offset ;
+#if defined(__AVX2__)
+	const __m256i nibble32 = _mm256_set1_epi8(0x0f) ;
+	const __m256i low_first32 = _mm256_broadcastsi128_si256(_mm_loadu_si128((__m128i *)low_first)) ;
+	const __m256i high_first32 = _mm256_broadcastsi128_si256(_mm_loadu_si128((__m128i *)high_first)) ;
+	const __m256i low_second32 = _mm256_broadcastsi128_si256(_mm_loadu_si128((__m128i *)low_second)) ;
+	const __m256i high_second32 = _mm256_broadcastsi128_si256(_mm_loadu_si128((__m128i *)high_second)) ;
+	for( ; i+35 <= length ; i += 32 )	// leaves room to read the whole key at any candidate
 	{
-		endian_fixup(&(afft->isample),sizeof(afft->isample)) ;
-		endian_fixup(&(afft->qsample),sizeof(afft->qsample)) ;
+		__m256i v0 = _mm256_loadu_si256((__m256i *)(file+i)) ;
+		__m256i v1 = _mm256_loadu_si256((__m256i *)(file+i+1)) ;
+		__m256i groups0 = _mm256_and_si256(_mm256_shuffle_epi8(low_first32,_mm256_and_si256(v0,nibble32)),_mm256_shuffle_epi8(high_first32,_mm256_and_si256(_mm256_srli_epi16(v0,4),nibble32))) ;
+		__m256i groups1 = _mm256_and_si256(_mm256_shuffle_epi8(low_second32,_mm256_and_si256(v1,nibble32)),_mm256_shuffle_epi8(high_second32,_mm256_and_si256(_mm256_srli_epi16(v1,4),nibble32))) ;
+		__m256i misses = _mm256_cmpeq_epi8(_mm256_and_si256(groups0,groups1),_mm256_setzero_si256()) ;
+		for( uint32_t mask = ~(uint32_t )_mm256_movemask_epi8(misses) ; mask != 0 ; mask &= mask-1 )
+		{
+			uint64_t candidate = i + __builtin_ctz(mask) ;
+			fourcc key ;
+			memcpy(&key,file+candidate,sizeof(key)) ;
+			endian_fixup(&key,sizeof(key)) ;
+			if( known_key(key) )
+				return candidate ;
+		}
 	}
-	return 0 ;
-}
-
-int dump_block_afft(struct node *node, struct config *config, FILE *outfile)
-{
-	if( node->size < sizeof(struct block_iqdata_float) )		// hardcoded type
+#endif
+#if defined(__SSSE3__)
+	const __m128i nibble16 = _mm_set1_epi8(0x0f) ;
+	const __m128i low_first16 = _mm_loadu_si128((__m128i *)low_first) ;
+	const __m128i high_first16 = _mm_loadu_si128((__m128i *)high_first) ;
+	const __m128i low_second16 = _mm_loadu_si128((__m128i *)low_second) ;
+	const __m128i high_second16 = _mm_loadu_si128((__m128i *)high_second) ;
+	for( ; i+19 <= length ; i += 16 )
 	{
-		fprintf(stderr,"Block '%s' is truncated\n",strkey(KEY_afft)) ;
-		return 1 ;
+		__m128i v0 = _mm_loadu_si128((__m128i *)(file+i)) ;
+		__m128i v1 = _mm_loadu_si128((__m128i *)(file+i+1)) ;
+		__m128i groups0 = _mm_and_si128(_mm_shuffle_epi8(low_first16,_mm_and_si128(v0,nibble16)),_mm_shuffle_epi8(high_first16,_mm_and_si128(_mm_srli_epi16(v0,4),nibble16))) ;
+		__m128i groups1 = _mm_and_si128(_mm_shuffle_epi8(low_second16,_mm_and_si128(v1,nibble16)),_mm_shuffle_epi8(high_second16,_mm_and_si128(_mm_srli_epi16(v1,4),nibble16))) ;
+		__m128i misses = _mm_cmpeq_epi8(_mm_and_si128(groups0,groups1),_mm_setzero_si128()) ;
+		for( uint32_t mask = ~_mm_movemask_epi8(misses) & 0xffff ; mask != 0 ; mask &= mask-1 )
+		{
+			uint64_t candidate = i + __builtin_ctz(mask) ;
+			fourcc key ;
+			memcpy(&key,file+candidate,sizeof(key)) ;
+			endian_fixup(&key,sizeof(key)) ;
+			if( known_key(key) )
+				return candidate ;
+		}
 	}
-	if( config->bin_format != BINFORMAT_CVIQ )	// TODO check if the typecasting is needed
+#elif defined(__SSE2__)
+	__m128i first16[MAX_BLOCK_TYPES] ;	// without SSSE3, compare with the first two bytes of every key
+	__m128i second16[MAX_BLOCK_TYPES] ;
+	for( int k = 0 ; k < nkeys ; k++ )
 	{
-		fprintf(stderr,"Cannot handle BINFORMAT %u\n",(uint32_t )config->bin_format) ;		// TODO check if the typecasting is needed
-		return 1 ;
+		first16[k] = _mm_set1_epi8(Global_registry.schemas[k]->key >> 24) ;
+		second16[k] = _mm_set1_epi8(Global_registry.schemas[k]->key >> 16) ;
 	}
-	if( (uint32_t )config->bin_type != BINTYPE_FLT4 )	// TODO check typecast
+	for( ; i+19 <= length ; i += 16 )
 	{
-		fprintf(stderr,"Cannot handle BINTYPE %u\n",(uint32_t )config->bin_type) ;
-		return 1 ;
+		__m128i v0 = _mm_loadu_si128((__m128i *)(file+i)) ;
+		__m128i v1 = _mm_loadu_si128((__m128i *)(file+i+1)) ;
+		__m128i hits = _mm_setzero_si128() ;
+		for( int k = 0 ; k < nkeys ; k++ )
+			hits = _mm_or_si128(hits,_mm_and_si128(_mm_cmpeq_epi8(v0,first16[k]),_mm_cmpeq_epi8(v1,second16[k]))) ;
+		for( uint32_t mask = _mm_movemask_epi8(hits) ; mask != 0 ; mask &= mask-1 )
+		{
+			uint64_t candidate = i + __builtin_ctz(mask) ;
+			fourcc key ;
+			memcpy(&key,file+candidate,sizeof(key)) ;
+			endian_fixup(&key,sizeof(key)) ;
+			if( known_key(key) )
+				return candidate ;
+		}
 	}
-	fprintf(outfile,"%s\n",strkey(KEY_afft)) ;
-	struct block_iqdata_float *afft = (struct block_iqdata_float *)(node->data) ;		// hardcoded type
-	int nsamples = (node->size)/sizeof(struct block_iqdata_float) ;		// hardcoded type
-	for( int loop = 0 ; loop < nsamples ; loop++, afft++ )
+#endif
+	for( ; i+sizeof(fourcc) <= length ; i++ )	// the rest, or everything on other processors, with the nibble tables a byte at a time
 	{
-		double isample = afft->isample ;		// hardcoded type
-		double qsample = afft->qsample ;		// hardcoded type
-		fprintf(outfile,"%3d % .20lf % .20lf\n",loop,isample,qsample) ;
+		if( (low_first[file[i] & 0x0f] & high_first[file[i] >> 4] & low_second[file[i+1] & 0x0f] & high_second[file[i+1] >> 4]) == 0 )
+			continue ;
+		fourcc key ;
+		memcpy(&key,file+i,sizeof(key)) ;
+		endian_fixup(&key,sizeof(key)) ;
+		if( known_key(key) )
+			return i ;
 	}
-	fprintf(outfile,"\n") ;
-	return 0 ;
+	return length ;
 }
 
-int read_iqdata_samples(struct block_iqdata_float *, int, struct config *, FILE *) ;	// declared here because it depends on the struct definition		// hardcoded type
 
-int make_node_afft(struct node *list, struct config *config, FILE *fd)		// creates a new node for afft block
+// Random access to the iq samples of an RS file, for programs that want a few cells rather than a whole dump.
+// The file is mapped read-only and nothing is parsed up front except the HEAD blocks, so a read only touches the pages it needs.
+// The samples of a sweep are stored range by range, with the channels of each range cell next to each other,
+// so the sample for a channel and range is number range*nchannels+channel in the afft (or ifft) block.
+
+int rs_open(struct rs_reader *reader, char *filename)	// maps an RS file and finds its sweeps, returns 0 on success
+// a gzip or xz compressed file is decompressed into memory instead of being mapped
+// uses the sweep index written by rsdump -i if it is up to date, otherwise walks the block headers
 {
-	struct node *newnode = malloc(sizeof(struct node)) ;
-	if( newnode == NULL )
+	memset(reader,0,sizeof(struct rs_reader)) ;
+	if( init_block_registry() )
+		return 1 ;
+	FILE *rsfile = fopen(filename,"rb") ;
+	if( rsfile == NULL )
 	{
-		fprintf(stderr,"Malloc error on list node\n") ;
+		fprintf(stderr,"Cannot open input file '%s'\n",filename) ;
 		return 1 ;
 	}
-	memset(newnode,0,sizeof(struct node)) ;
-	list->next = newnode ;
-	newnode->key = KEY_afft ;
-	int afft_lines = count_iqdata_lines(fd) ;		// count lines, 1 line per sample (i and q), use this to malloc space for the entire block
-	if( afft_lines <= 0 )
+	struct stat st ;
+	if( fstat(fileno(rsfile),&st) != 0 || !S_ISREG(st.st_mode) || (uint64_t )st.st_size <= sizeof(struct block_header) )
 	{
-		fprintf(stderr,"Error counting lines in '%s' block\n",strkey(KEY_afft)) ;
+		fprintf(stderr,"Cannot read '%s', it is not an RS file\n",filename) ;
+		fclose(rsfile) ;
 		return 1 ;
 	}
-	if( afft_lines % 3 != 0 )
+	void *map = mmap(NULL,st.st_size,PROT_READ,MAP_SHARED,fileno(rsfile),0) ;	// the samples are copied out before they are fixed up, so the map is never written
+	if( map == MAP_FAILED )
 	{
-		fprintf(stderr,"Bad number of lines: %d, reading '%s' block. Lines must be a multiple of 3\n",afft_lines,strkey(KEY_afft)) ;
+		fprintf(stderr,"Cannot map '%s'\n",filename) ;
+		fclose(rsfile) ;
 		return 1 ;
 	}
-	if( Debug ) { fprintf(stderr,"debug: make_node_afft: afft_lines=%u\n",afft_lines) ; }
-	int afft_samples = afft_lines ;	// a sample is a line of I,Q values
-	size_t afft_size = afft_samples * sizeof(struct block_iqdata_float) ;		// hardcoded type
-	if( Debug ) { fprintf(stderr,"debug: make_node_afft: afft_samples=%d afft_size=%zu\n",afft_samples,afft_size) ; }
-	struct block_iqdata_float *afft_data = malloc(afft_size) ;		// hardcoded type
-	if( afft_data == NULL )
+	madvise(map,st.st_size,MADV_RANDOM) ;	// don't read ahead around the cells that are asked for
+	reader->file = map ;
+	reader->filesize = st.st_size ;
+	reader->mapped = 1 ;
+	if( compression_format(reader->file,SIZE_MAGIC) != COMPRESSION_NONE )	// compressed data can't be read in place, so decompress all of it into memory
 	{
-		fprintf(stderr,"Malloc error on '%s' data block\n",strkey(KEY_afft)) ;
-		return 1 ;
+		munmap(map,st.st_size) ;
+		reader->file = NULL ;
+		reader->mapped = 0 ;
+		FILE *stream = NULL ;
+		if( fseeko(rsfile,0,SEEK_SET) == 0 && (stream = open_decompressed(rsfile)) != NULL )
+		{
+			reader->file = load_binary_file(stream,&(reader->filesize)) ;
+			fclose(stream) ;
+		}
+		if( reader->file == NULL || reader->filesize <= sizeof(struct block_header) )
+		{
+			fprintf(stderr,"Cannot read '%s', it does not decompress to an RS file\n",filename) ;
+			fclose(rsfile) ;
+			rs_close(reader) ;
+			return 1 ;
+		}
 	}
-	memset(afft_data,0,afft_size) ;
-	newnode->data = (unsigned char *)afft_data ;
-	newnode->size = afft_size ;
-	if( read_iqdata_samples(afft_data,afft_samples,config,fd) )	// read lines of i, q values as float and store them in afft_data
+	int err = check_header(reader->file) ;
+	uint64_t size = 0 ;
+	uint64_t offset = 0 ;
+	if( err == 0 && (offset = find_head_block(reader,KEY_cnst,&size)) != 0 )
 	{
-		fprintf(stderr,"Error reading '%s' block\n",strkey(KEY_afft)) ;
-		return 1 ;
+		struct block_cnst cnst ;
+		struct node node ;
+		memset(&node,0,sizeof(struct node)) ;
+		node.key = KEY_cnst ;
+		node.size = size < sizeof(cnst) ? size : sizeof(cnst) ;
+		node.data = (unsigned char *)&cnst ;
+		memcpy(&cnst,reader->file+offset,node.size) ;
+		err = fixup_block(&node) ;
+		reader->nchannels = cnst.nchannels ;
+		reader->nranges = cnst.nranges ;
+		reader->nsweeps = cnst.nsweeps ;
 	}
-	return 0 ;
-}
-
-int count_iqdata_lines(FILE *fd)		// count how many lines of i,q data there are before we hit a blank line (end of block)
-{
-	char line[SIZE_LINE] ;
-	int count = 0 ;
-	unsigned long afft_start = ftell(fd) ;
-	while( fgets(line,SIZE_LINE,fd) != NULL )
+	if( err == 0 && (reader->nchannels <= 0 || reader->nranges <= 0) )
 	{
-		chomp(line,SIZE_LINE) ;				// remove newline
-		if( strlen(line) < 1 )
-			break ;
-		count++ ;
+		fprintf(stderr,"Cannot read '%s', it has no '%s' block with channels and ranges\n",filename,KEYNAME(KEY_cnst)) ;
+		err = 1 ;
 	}
-	fseek(fd,afft_start,SEEK_SET) ;
-	return count ;
-}
-
-int read_iqdata_samples(struct block_iqdata_float *iqdata, int iqsamples, struct config *config, FILE *fd)		// hardcoded type
-{
-	char line[SIZE_LINE] ;
-	if( (uint32_t )config->bin_format != BINFORMAT_CVIQ )
+	if( err == 0 && (offset = find_head_block(reader,KEY_fbin,&size)) != 0 )
 	{
-		fprintf(stderr,"Cannot handle BINFORMAT %u\n",(uint32_t )config->bin_format) ;
-		return 1 ;
+		struct block_fbin fbin ;
+		struct node node ;
+		memset(&node,0,sizeof(struct node)) ;
+		node.key = KEY_fbin ;
+		node.size = size < sizeof(fbin) ? size : sizeof(fbin) ;
+		node.data = (unsigned char *)&fbin ;
+		memcpy(&fbin,reader->file+offset,node.size) ;
+		err = fixup_block(&node) ;
+		reader->bin_format = fbin.bin_format ;
+		reader->bin_type = fbin.bin_type ;
 	}
-	if( (uint32_t )config->bin_type != BINTYPE_FLT4 )
+	if( err == 0 && reader->bin_format != BINFORMAT_CVIQ )
 	{
-		fprintf(stderr,"Cannot handle BINTYPE %u\n",(uint32_t )config->bin_type) ;
-		return 1 ;
+		fprintf(stderr,"Cannot handle BINFORMAT %u\n",(uint32_t )reader->bin_format) ;
+		err = 1 ;
 	}
-	unsigned long iqstart = ftell(fd) ;
-	for( int sample_count = 0 ; sample_count < iqsamples ; sample_count++, iqdata++ )
+	if( err == 0 && reader->bin_type != BINTYPE_FLT4 )
 	{
-		if( fgets(line,SIZE_LINE,fd) == NULL ) return 1 ;
-		chomp(line,SIZE_LINE) ;
-		if( strlen(line) == 0 ) return 1 ;
-		int count ;
-		double i ;
-		double q ;
-		int convert_count = sscanf(line,"%d %lf %lf",&count,&i,&q) ;
-		if( convert_count != 3 )
+		fprintf(stderr,"Cannot handle BINTYPE %u\n",(uint32_t )reader->bin_type) ;
+		err = 1 ;
+	}
+	if( err == 0 )
+	{
+		char indexname[FILENAME_MAX] ;
+		snprintf(indexname,sizeof(indexname),"%s%s",filename,SUFFIX_INDEX) ;
+		if( load_sweep_index(indexname,rsfile,&(reader->index)) )
 		{
-			fprintf(stderr,"Failed to read iqdata %d from line %s\n",sample_count,line) ;
-			return 1 ;
+			if( Debug ) { fprintf(stderr,"debug: rs_open: no index for '%s', walking the headers\n",filename) ; }
+			err = index_mapped_file(reader->file,reader->filesize,&(reader->index)) ;
 		}
-		iqdata->isample = (float )i ;			// hardcoded type
-		iqdata->qsample = (float )q ;			// hardcoded type
-		//if( Debug && (sample_count == 0) ) { fprintf(stderr,"debug: read_iqdata_samples: double i=%lf q=%lf, scalar_one=%lf scalar_two=%lf, factor=%lf int i=%d q=%d\n",i,q,config->scalar_one,config->scalar_two,factor,iqdata->isample,iqdata->qsample) ; }
 	}
-	//fseek(fd,iqstart,SEEK_SET) ;	// not sure why the file descriptor needs to be rewound, so commented out for now
-	return 0 ;
+	fclose(rsfile) ;	// the map or the decompressed copy stays valid without the file
+	if( err )
+		rs_close(reader) ;
+	return err ;
 }
 
-int gen_block_afft(struct node *node, FILE *outfile)
+void rs_close(struct rs_reader *reader)
 {
-	struct block_iqdata_float *afft = (struct block_iqdata_float *)(node->data) ;
-	endian_fixup(&(node->key),sizeof(node->key)) ;
-	if( fwrite(&(node->key),sizeof(node->key),1,outfile) != 1 ) return 1 ;
-	int actual_size = node->size ;
-	endian_fixup(&(node->size),sizeof(node->size)) ;
-	if( fwrite(&(node->size),sizeof(node->size),1,outfile) != 1 ) return 1 ;
-	int sample_count = actual_size/sizeof(struct block_iqdata_float) ;
-	if( Debug ) { fprintf(stderr,"debug: gen_block_afft: actual size %d, sample_count %d\n",actual_size,sample_count) ; }
-	for( int count = 0 ; count < sample_count ; count++, afft++ )
+	if( reader->file != NULL && reader->mapped )
+		munmap(reader->file,reader->filesize) ;
+	else
+		free(reader->file) ;
+	free_sweep_index(&(reader->index)) ;
+	memset(reader,0,sizeof(struct rs_reader)) ;
+}
+
+uint64_t find_head_block(struct rs_reader *reader, fourcc key, uint64_t *size)	// returns the offset of the data block of a HEAD block, 0 if it isn't there
+// walks the headers from the start of the file and stops at BODY, so only the first few KB are touched
+{
+	uint64_t offset = 0 ;
+	struct node node ;
+	while( offset < reader->filesize )
 	{
-		//if( Debug && (count == 0) ) { fprintf(stderr,"debug: gen_block_afft: sample 0 i=%d q=%d\n",afft->isample,afft->qsample) ; }
-		endian_fixup(&(afft->isample),sizeof(afft->isample)) ;
-		if( fwrite(&(afft->isample),sizeof(afft->isample),1,outfile) != 1 ) return 1 ;
-		endian_fixup(&(afft->qsample),sizeof(afft->qsample)) ;
-		if( fwrite(&(afft->qsample),sizeof(afft->qsample),1,outfile) != 1 ) return 1 ;
+		unsigned int length_header = decode_block_header(reader->file+offset,reader->filesize-offset,&node) ;
+		if( length_header == 0 || node.key == KEY_BODY )
+			break ;
+		offset += length_header ;
+		if( superblock(node.key) )	// the first sub-block header follows immediately
+			continue ;
+		if( node.size > reader->filesize - offset )
+			node.size = reader->filesize - offset ;
+		if( node.key == key )
+		{
+			*size = node.size ;
+			return offset ;
+		}
+		offset += node.size ;
 	}
+	fprintf(stderr,"Cannot find block '%s' in the header\n",KEYNAME(key)) ;
 	return 0 ;
 }
 
-
-int fixup_data_ifft(struct node *node)
+int rs_read_cells(struct rs_reader *reader, fourcc key, uint64_t sweep, int channel, int first_range, int count, int stride, struct block_iqdata_float *iq)
+// copies the samples of one channel for count range cells, starting at first_range and stepping by stride, from an afft or ifft block
+// iq must have room for count samples, returns 0 on success
 {
-	if( node->size < sizeof(struct block_iqdata_float) )
+	int slot = sweep_key_slot(key) ;
+	if( key != KEY_afft && key != KEY_ifft )
 	{
-		fprintf(stderr,"Block '%s' is truncated\n",strkey(KEY_ifft)) ;
+		fprintf(stderr,"Cannot read samples from block '%s'\n",KEYNAME(key)) ;
 		return 1 ;
 	}
-	struct block_iqdata_float *ifft = (struct block_iqdata_float *)node->data ;
-	int nsamples = (node->size)/sizeof(struct block_iqdata_float) ;
-	for( int loop = 0 ; loop < nsamples ; loop++, ifft++ )
+	if( sweep >= reader->index.nsweeps )
 	{
-		endian_fixup(&(ifft->isample),sizeof(ifft->isample)) ;
-		endian_fixup(&(ifft->qsample),sizeof(ifft->qsample)) ;
+		fprintf(stderr,"Sweep %" PRIu64 " is not in the file, it has %" PRIu64 " sweeps\n",sweep,reader->index.nsweeps) ;
+		return 1 ;
 	}
-	return 0 ;
-}
-
-int dump_block_ifft(struct node *node, struct config *config, FILE *outfile)
-{
-	if( node->size < sizeof(struct block_iqdata_float) )		// hardcoded type
+	if( channel < 0 || channel >= reader->nchannels || count < 1 || stride < 1 || first_range < 0
+		|| first_range + (int64_t )(count-1)*stride >= reader->nranges )
 	{
-		fprintf(stderr,"Block '%s' is truncated\n",strkey(KEY_ifft)) ;
+		fprintf(stderr,"Cannot read channel %d, ranges %d to %" PRId64 " by %d, the file has %d channels and %d ranges\n",
+			channel,first_range,first_range+(int64_t )(count-1)*stride,stride,reader->nchannels,reader->nranges) ;
 		return 1 ;
 	}
-	if( (uint32_t )config->bin_format != BINFORMAT_CVIQ )
+	struct index_entry *entry = &(reader->index.sweeps[sweep].block[slot]) ;
+	if( entry->offset == 0 )
 	{
-		fprintf(stderr,"Cannot handle BINFORMAT %u\n",(uint32_t )config->bin_format) ;
+		fprintf(stderr,"Sweep %" PRIu64 " has no '%s' block\n",sweep,KEYNAME(key)) ;
 		return 1 ;
 	}
-	if( (uint32_t )config->bin_type != BINTYPE_FLT4 )
+	uint64_t last = (uint64_t )(first_range + (int64_t )(count-1)*stride)*reader->nchannels + channel ;	// the sample furthest into the block
+	if( (last+1)*sizeof(struct block_iqdata_float) > entry->size )
 	{
-		fprintf(stderr,"Cannot handle BINTYPE %u\n",(uint32_t )config->bin_type) ;
+		fprintf(stderr,"Block '%s' is truncated\n",KEYNAME(key)) ;
 		return 1 ;
 	}
-	fprintf(outfile,"%s\n",strkey(KEY_ifft)) ;
-	struct block_iqdata_float *ifft = (struct block_iqdata_float *)(node->data) ;		// hardcoded type
-	int nsamples = (node->size)/sizeof(struct block_iqdata_float) ;		// hardcoded type
-	for( int loop = 0 ; loop < nsamples ; loop++, ifft++ )
+	unsigned char *data = reader->file + entry->offset ;
+	for( int n = 0 ; n < count ; n++ )
 	{
-		double isample = ifft->isample ;		// hardcoded type
-		double qsample = ifft->qsample ;		// hardcoded type
-		fprintf(outfile,"%3d % .16lf % .16lf\n",loop,isample,qsample) ;
+		uint64_t sample = (uint64_t )(first_range + (int64_t )n*stride)*reader->nchannels + channel ;
+		memcpy(&(iq[n]),data+sample*sizeof(struct block_iqdata_float),sizeof(struct block_iqdata_float)) ;
 	}
-	fprintf(outfile,"\n") ;
+	endian_fixup_bulk4(iq,2*(size_t )count) ;	// the I and Q samples as one array of floats		// hardcoded type
 	return 0 ;
 }
 
-int make_node_ifft(struct node *list, struct config *config, FILE *fd)		// creates a new node for ifft block
+int rs_read_cell(struct rs_reader *reader, fourcc key, uint64_t sweep, int channel, int range, struct block_iqdata_float *iq)	// copies one sample
 {
-	struct node *newnode = malloc(sizeof(struct node)) ;
-	if( newnode == NULL )
+	return rs_read_cells(reader,key,sweep,channel,range,1,1,iq) ;
+}
+
+int rs_read_sweep(struct rs_reader *reader, fourcc key, uint64_t sweep, struct block_iqdata_float *iq)	// copies every sample of a sweep
+// iq must have room for nchannels*nranges samples, in the order they are stored
+{
+	int slot = sweep_key_slot(key) ;
+	if( key != KEY_afft && key != KEY_ifft )
 	{
-		fprintf(stderr,"Malloc error on list node\n") ;
+		fprintf(stderr,"Cannot read samples from block '%s'\n",KEYNAME(key)) ;
 		return 1 ;
 	}
-	memset(newnode,0,sizeof(struct node)) ;
-	list->next = newnode ;
-	newnode->key = KEY_ifft ;
-	int ifft_lines = count_iqdata_lines(fd) ;		// count lines, 1 line per sample (i and q), use this to malloc space for the entire block
-	if( ifft_lines <= 0 )
+	if( sweep >= reader->index.nsweeps )
 	{
-		fprintf(stderr,"Error counting lines in '%s' block\n",strkey(KEY_ifft)) ;
+		fprintf(stderr,"Sweep %" PRIu64 " is not in the file, it has %" PRIu64 " sweeps\n",sweep,reader->index.nsweeps) ;
 		return 1 ;
 	}
-	if( ifft_lines % 3 != 0 )
+	struct index_entry *entry = &(reader->index.sweeps[sweep].block[slot]) ;
+	if( entry->offset == 0 )
 	{
-		fprintf(stderr,"Bad number of lines: %d, reading '%s' block. Lines must be a multiple of 3\n",ifft_lines,strkey(KEY_ifft)) ;
+		fprintf(stderr,"Sweep %" PRIu64 " has no '%s' block\n",sweep,KEYNAME(key)) ;
 		return 1 ;
 	}
-	if( Debug ) { fprintf(stderr,"debug: make_node_ifft: ifft_lines=%u\n",ifft_lines) ; }
-	int ifft_samples = ifft_lines ;	// a sample is a line of I,Q values
-	size_t ifft_size = ifft_samples * sizeof(struct block_iqdata_float) ;		// hardcoded type
-	if( Debug ) { fprintf(stderr,"debug: make_node_ifft: ifft_samples=%d ifft_size=%zu\n",ifft_samples,ifft_size) ; }
-	struct block_iqdata_float *ifft_data = malloc(ifft_size) ;		// hardcoded type
-	if( ifft_data == NULL )
+	size_t nsamples = (size_t )reader->nchannels*reader->nranges ;
+	if( nsamples*sizeof(struct block_iqdata_float) > entry->size )
 	{
-		fprintf(stderr,"Malloc error on '%s' data block\n",strkey(KEY_ifft)) ;
+		fprintf(stderr,"Block '%s' is truncated\n",KEYNAME(key)) ;
 		return 1 ;
 	}
-	memset(ifft_data,0,ifft_size) ;
-	newnode->data = (unsigned char *)ifft_data ;
-	newnode->size = ifft_size ;
-	if( read_iqdata_samples(ifft_data,ifft_samples,config,fd) )	// read lines of i, q values as float and store them in ifft_data
+	memcpy(iq,reader->file+entry->offset,nsamples*sizeof(struct block_iqdata_float)) ;
+	endian_fixup_bulk4(iq,2*nsamples) ;	// the I and Q samples as one array of floats		// hardcoded type
+	return 0 ;
+}
+
+int rsdump_select(char *infilename, FILE *outfile, int just_header, int hex, struct dump_filter *filter)	// top level function in rsdump select mode
+// open the file for random access, with its sweep index if it is up to date
+// walk the block headers up to BODY, dumping the selected blocks of the header
+// dump the selected blocks of each selected sweep, found through the index, with any other blocks between them
+// then walk the headers after BODY, normally just END
+// a block that isn't selected is never read or fixed up, so with an index the time depends on the selection rather than the file
+{
+	struct rs_reader reader ;
+	if( rs_open(&reader,infilename) )
+		return 1 ;
+	struct output out ;
+	if( out_open(&out,outfile,hex) )
 	{
-		fprintf(stderr,"Error reading '%s' block\n",strkey(KEY_ifft)) ;
+		rs_close(&reader) ;
 		return 1 ;
 	}
-	return 0 ;
+	struct config config ;
+	memset(&config,0,sizeof(struct config)) ;
+	config.bin_format = reader.bin_format ;		// rs_open() has checked these, and the fbin block may not be selected
+	config.bin_type = reader.bin_type ;
+	unsigned char *buffer = NULL ;		// a copy of the current block, so the mapped file is never written
+	uint64_t buffer_size = 0 ;
+	int err = 0 ;
+	uint64_t offset = 0 ;			// offset in the file of the next block header
+	struct node node ;
+	while( err == 0 && offset < reader.filesize )
+	{
+		unsigned int length_header = decode_block_header(reader.file+offset,reader.filesize-offset,&node) ;
+		if( length_header == 0 )
+			break ;
+		if( just_header && node.key == KEY_BODY )	// the header is complete
+			break ;
+		offset += length_header ;
+		node.offset = offset ;
+		if( !superblock(node.key) && node.size > reader.filesize - offset )
+		{
+			fprintf(stderr,"Block '%s' size truncted from %" PRIu64 " to %" PRIu64 " bytes\n",KEYNAME(node.key),node.size,reader.filesize-offset) ;
+			node.size = reader.filesize - offset ;
+		}
+		if( selected_key(filter,node.key) )
+			err = dump_copy(&node,reader.file+offset,&buffer,&buffer_size,&config,&out) ;
+		if( err == 0 && node.key == KEY_BODY )	// the sweeps come from the index, then carry on after BODY
+		{
+			uint64_t end = node.size < reader.filesize - offset ? offset + node.size : reader.filesize ;
+			err = dump_sweeps(&reader,filter,offset,end,&buffer,&buffer_size,&config,&out) ;
+			offset = end ;
+		}
+		else if( !superblock(node.key) )	// the first sub-block header of a superblock follows immediately
+			offset += node.size ;
+	}
+	err |= out_close(&out) ;
+	free(buffer) ;
+	rs_close(&reader) ;
+	return err ;
 }
 
-int gen_block_ifft(struct node *node, FILE *outfile)
+int dump_sweeps(struct rs_reader *reader, struct dump_filter *filter, uint64_t body, uint64_t end, unsigned char **buffer, uint64_t *buffer_size, struct config *config, struct output *out)	// dumps the selected blocks of the selected sweeps in the index
+// a sweep runs from the header of its first block in the index to that of the next sweep, or the end of BODY at end, and the block headers
+// in between are walked so blocks the index doesn't record are dumped in place; any blocks in BODY before the first sweep go with it
 {
-	struct block_iqdata_float *ifft = (struct block_iqdata_float *)(node->data) ;
-	endian_fixup(&(node->key),sizeof(node->key)) ;
-	if( fwrite(&(node->key),sizeof(node->key),1,outfile) != 1 ) return 1 ;
-	int actual_size = node->size ;
-	endian_fixup(&(node->size),sizeof(node->size)) ;
-	if( fwrite(&(node->size),sizeof(node->size),1,outfile) != 1 ) return 1 ;
-	int sample_count = actual_size/sizeof(struct block_iqdata_float) ;
-	if( Debug ) { fprintf(stderr,"debug: gen_block_ifft: actual size %d, sample_count %d\n",actual_size,sample_count) ; }
-	for( int count = 0 ; count < sample_count ; count++, ifft++ )
+	int indx_slot = sweep_key_slot(KEY_indx) ;
+	for( uint64_t sweep = filter->first_sweep ; sweep < reader->index.nsweeps && sweep <= filter->last_sweep ; sweep++ )
 	{
-		//if( Debug && (count == 0) ) { fprintf(stderr,"debug: gen_block_ifft: sample 0 i=%d q=%d\n",ifft->isample,ifft->qsample) ; }
-		endian_fixup(&(ifft->isample),sizeof(ifft->isample)) ;
-		if( fwrite(&(ifft->isample),sizeof(ifft->isample),1,outfile) != 1 ) return 1 ;
-		endian_fixup(&(ifft->qsample),sizeof(ifft->qsample)) ;
-		if( fwrite(&(ifft->qsample),sizeof(ifft->qsample),1,outfile) != 1 ) return 1 ;
+		struct sweep_entry *entry = &(reader->index.sweeps[sweep]) ;
+		if( filter->by_indx )
+		{
+			struct index_entry *indx = &(entry->block[indx_slot]) ;
+			struct block_indx value ;
+			if( indx->offset == 0 || indx->size < sizeof(value) )
+				continue ;
+			memcpy(&value,reader->file+indx->offset,sizeof(value)) ;
+			endian_fixup(&(value.index),sizeof(value.index)) ;
+			if( value.index < filter->first_indx || value.index > filter->last_indx )
+				continue ;
+		}
+		uint64_t offset = sweep == 0 ? body : sweep_start(reader,sweep) ;
+		uint64_t last = sweep+1 < reader->index.nsweeps ? sweep_start(reader,sweep+1) : end ;
+		if( offset < body || last > end || offset > last )
+		{
+			fprintf(stderr,"The sweep index doesn't fit the file at sweep %" PRIu64 "\n",sweep) ;
+			return 1 ;
+		}
+		while( offset < last )
+		{
+			struct node node ;
+			memset(&node,0,sizeof(struct node)) ;
+			unsigned int length_header = decode_block_header(reader->file+offset,last-offset,&node) ;
+			if( length_header == 0 )
+				return 1 ;
+			offset += length_header ;
+			if( superblock(node.key) )	// not expected in BODY, its sub-blocks follow
+				continue ;
+			if( node.size > last - offset )
+			{
+				fprintf(stderr,"Block '%s' size truncted from %" PRIu64 " to %" PRIu64 " bytes\n",KEYNAME(node.key),node.size,last-offset) ;
+				node.size = last - offset ;
+			}
+			node.offset = offset ;
+			offset += node.size ;
+			if( !selected_key(filter,node.key) )
+				continue ;
+			int err ;
+			if( filter->cells && (node.key == KEY_afft || node.key == KEY_ifft) )
+				err = dump_cells(reader,node.key,sweep,filter,out) ;
+			else
+				err = dump_copy(&node,reader->file+node.offset,buffer,buffer_size,config,out) ;
+			if( err )
+				return 1 ;
+		}
 	}
 	return 0 ;
 }
 
+uint64_t sweep_start(struct rs_reader *reader, uint64_t sweep)	// returns the offset of the header of the first block of a sweep in the index, or 0 if it has none
+{
+	struct sweep_entry *entry = &(reader->index.sweeps[sweep]) ;
+	uint64_t start = 0 ;
+	for( int slot = 0 ; slot < NUM_SWEEP_KEYS ; slot++ )
+	{
+		struct index_entry *block = &(entry->block[slot]) ;
+		if( block->offset != 0 && (start == 0 || block->offset - header_size(block->size) < start) )
+			start = block->offset - header_size(block->size) ;
+	}
+	return start ;
+}
 
-int fixup_data_end(struct node *node)
+int dump_copy(struct node *node, unsigned char *data, unsigned char **buffer, uint64_t *buffer_size, struct config *config, struct output *out)	// dumps a block from a copy of its data, which the buffer grows to hold
 {
-	return 0 ;
+	node->parent = -1 ;
+	node->data = NULL ;
+	node->bigendian = 0 ;
+	if( !superblock(node->key) )
+	{
+		if( node->size > *buffer_size )
+		{
+			unsigned char *bigger = realloc(*buffer,node->size) ;
+			if( bigger == NULL )
+			{
+				fprintf(stderr,"Cannot get memory for block '%s' with %" PRIu64 " bytes\n",KEYNAME(node->key),node->size) ;
+				return 1 ;
+			}
+			*buffer = bigger ;
+			*buffer_size = node->size ;
+		}
+		memcpy(*buffer,data,node->size) ;
+		node->data = *buffer ;
+		node->bigendian = 1 ;
+	}
+	return dump_block(node,config,out) ;
+}
+
+int dump_cells(struct rs_reader *reader, fourcc key, uint64_t sweep, struct dump_filter *filter, struct output *out)	// dumps the samples of the selected channels and range cells of an afft or ifft block
+// the lines are the ones a whole dump of the block has, numbered by their place in the block, so only the selected samples are read and formatted
+{
+	out_key(out,key) ;
+	out_char(out,'\n') ;
+	uint64_t last = filter->last_range < (uint64_t )reader->nranges ? filter->last_range : (uint64_t )reader->nranges - 1 ;
+	int err = 0 ;
+	if( filter->first_range <= last )
+	{
+		int count = last - filter->first_range + 1 ;
+		struct block_iqdata_float *iq = malloc((size_t )reader->nchannels*count*sizeof(struct block_iqdata_float)) ;		// hardcoded type
+		if( iq == NULL )
+		{
+			fprintf(stderr,"Cannot get memory for %d range cells\n",count) ;
+			return 1 ;
+		}
+		for( int channel = 0 ; err == 0 && channel < reader->nchannels ; channel++ )	// each channel is a run of samples at a stride of nchannels
+		{
+			if( filter->channels == ALL_CHANNELS || (channel < 64 && (filter->channels >> channel) & 1) )
+				err = rs_read_cells(reader,key,sweep,channel,filter->first_range,count,1,iq+(size_t )channel*count) ;
+		}
+		for( int cell = 0 ; err == 0 && cell < count ; cell++ )		// in the order of the block, range by range
+		{
+			for( int channel = 0 ; channel < reader->nchannels ; channel++ )
+			{
+				if( filter->channels != ALL_CHANNELS && (channel >= 64 || !((filter->channels >> channel) & 1)) )
+					continue ;
+				struct block_iqdata_float *sample = &(iq[(size_t )channel*count+cell]) ;
+				char *line = out_reserve(out,SIZE_IQ_LINE) ;
+				if( line == NULL )
+					break ;
+				size_t index = (filter->first_range + cell)*reader->nchannels + channel ;
+				out->length += format_iq_line(index,sample->isample,sample->qsample,out->hex,line) ;		// hardcoded type
+			}
+		}
+		free(iq) ;
+	}
+	out_char(out,'\n') ;
+	return err | out->err ;
 }
 
-int dump_block_end(struct node *node, struct config *config, FILE *outfile)
+int selected_key(struct dump_filter *filter, fourcc key)	// returns 1 if blocks with this key are to be dumped
 {
-	fprintf(outfile,"%s\n",strkey(KEY_END)) ;
+	if( filter->nkeys == 0 )
+		return 1 ;
+	for( int i = 0 ; i < filter->nkeys ; i++ )
+	{
+		if( filter->keys[i] == key )
+			return 1 ;
+	}
 	return 0 ;
 }
 
-int make_node_end(struct node *list, struct config *config, FILE *fd)		// creates a new node for end block
+int parse_interval(char *text, uint64_t *first, uint64_t *last)	// reads "first", "first:last" or "first:" into an inclusive interval, returns 1 if it is bad
 {
-	struct node *newnode = malloc(sizeof(struct node)) ;
-	if( newnode == NULL )
+	char *end = text ;
+	if( isdigit((unsigned char )*end) )
+		*first = strtoull(text,&end,10) ;
+	*last = *first ;
+	if( end != text && *end == ':' )
+	{
+		char *next = end + 1 ;
+		*last = UINT64_MAX ;		// open ended
+		if( isdigit((unsigned char )*next) )
+			*last = strtoull(next,&end,10) ;
+		else
+			end = next ;
+	}
+	if( end == text || *end != '\0' || *last < *first )
 	{
-		fprintf(stderr,"Malloc error\n") ;
+		fprintf(stderr,"Bad interval '%s', it should be first or first:last\n",text) ;
 		return 1 ;
 	}
-	memset(newnode,0,sizeof(struct node)) ;
-	list->next = newnode ;
-	newnode->key = KEY_END ;
-	newnode->size = 0 ;
-	newnode->data = NULL ;
 	return 0 ;
 }
 
-int gen_block_end(struct node *node, FILE *outfile)
+int parse_channels(char *text, uint64_t *channels)	// reads a list of channel numbers separated by commas into a mask, returns 1 if it is bad
 {
-	endian_fixup(&(node->key),sizeof(node->key)) ;
-	if( fwrite(&(node->key),sizeof(node->key),1,outfile) != 1 ) return 1 ;
-	endian_fixup(&(node->size),sizeof(node->size)) ;
-	if( fwrite(&(node->size),sizeof(node->size),1,outfile) != 1 ) return 1 ;
+	*channels = 0 ;
+	for( char *p = text ; ; p++ )
+	{
+		char *end ;
+		unsigned long channel = isdigit((unsigned char )*p) ? strtoul(p,&end,10) : 64 ;
+		if( channel >= 64 || (*end != ',' && *end != '\0') )
+		{
+			fprintf(stderr,"Bad channel list '%s', it should be channel numbers from 0 to 63 separated by commas\n",text) ;
+			return 1 ;
+		}
+		*channels |= UINT64_C(1) << channel ;
+		p = end ;
+		if( *p == '\0' )
+			break ;
+	}
 	return 0 ;
 }
 
+int parse_keys(char *text, struct dump_filter *filter)	// adds a list of block keys separated by commas to the filter, returns 1 if it is bad
+// a key with fewer than 4 characters is padded with spaces, so "END" selects the END block
+{
+	char *saveptr = NULL ;
+	for( char *name = strtok_r(text,",",&saveptr) ; name != NULL ; name = strtok_r(NULL,",",&saveptr) )
+	{
+		size_t length = strlen(name) ;
+		if( length == 0 || length > sizeof(fourcc) || filter->nkeys == MAX_FILTER_KEYS )
+		{
+			fprintf(stderr,"Bad block key '%s', keys have up to 4 characters and there can be %d of them\n",name,MAX_FILTER_KEYS) ;
+			return 1 ;
+		}
+		char keyname[sizeof(fourcc)] = { ' ', ' ', ' ', ' ' } ;
+		memcpy(keyname,name,length) ;
+		fourcc key ;
+		memcpy(&key,keyname,sizeof(key)) ;
+		endian_fixup(&key,sizeof(key)) ;
+		filter->keys[filter->nkeys++] = key ;
+	}
+	return filter->nkeys == 0 ;
+}
 
-// end of block-specific functions
 
 
-void free_all_nodes(struct node *list)
+void free_node_table(struct node_table *table)		// frees the table, the data blocks belong to the file buffer
 {
-	while( list != NULL )
-	{
-		struct node *next = list->next ;
-		free(list) ;
-		list = next ;
-	}
+	free(table->nodes) ;
+	memset(table,0,sizeof(struct node_table)) ;
 }
 
-void free_all_nodes_and_data(struct node *list)
+void free_node_table_and_data(struct node_table *table)	// frees the table and the data block of each node
 {
-	while( list != NULL )
+	for( size_t i = 0 ; i < table->count ; i++ )
 	{
-		if( list->data != NULL )
-			free(list->data) ;
-		struct node *next = list->next ;
-		free(list) ;
-		list = next ;
+		if( table->nodes[i].data != NULL )
+			free(table->nodes[i].data) ;
 	}
+	free_node_table(table) ;
 }
 
 //END